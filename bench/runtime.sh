@@ -0,0 +1,45 @@
+#!/bin/bash -e
+#
+# Measures the speed of the code generated by 9cxx against a C compiler at -O0
+# and -O2, on the kernels in bench/runtime.
+#
+# Usage: bench/runtime.sh [ITERATIONS [REPEATS]]
+
+DIR=$(cd $(dirname $0) && pwd)
+CXX=$DIR/../src/9cxx
+CC=${CC:-clang}
+ITERATIONS=${1:-1000000}
+REPEATS=${2:-11}
+
+FORMAT=elf64
+CXXFLAGS="-fPIE -fno-leading-underscore"
+if [ "$(uname -s)" = "Darwin" ]
+then
+  FORMAT=macho64
+  CXXFLAGS="-fPIE"
+fi
+
+WORK=$(mktemp -d)
+trap "rm -rf $WORK" EXIT
+
+clang++ -O2 -c $DIR/runtime/harness.cpp -o $WORK/harness.o
+
+$CXX $CXXFLAGS < $DIR/runtime/kernels.cpp > $WORK/kernels.s 2>/dev/null
+nasm $WORK/kernels.s -f $FORMAT -o $WORK/9cxx.o
+$CC -O0 -fwrapv -c $DIR/runtime/kernels.c -o $WORK/O0.o
+$CC -O2 -fwrapv -c $DIR/runtime/kernels.c -o $WORK/O2.o
+
+for variant in 9cxx O0 O2
+do
+  clang++ $WORK/harness.o $WORK/$variant.o -o $WORK/$variant
+  $WORK/$variant $variant $ITERATIONS $REPEATS > $WORK/$variant.txt
+done
+
+# Columns of the harness output: label kernel min median mean stddev checksum
+echo "median ns/call (stddev)"
+printf "%-8s %16s %16s %16s %8s %8s\n" kernel 9cxx O0 O2 vs-O0 vs-O2
+paste $WORK/9cxx.txt $WORK/O0.txt $WORK/O2.txt | awk '{
+  status = ($7 == $14 && $7 == $21) ? "" : "  CHECKSUM MISMATCH"
+  printf "%-8s %8.2f (%5.2f) %8.2f (%5.2f) %8.2f (%5.2f) %7.2fx %7.2fx%s\n",
+         $2, $4, $6, $11, $13, $18, $20, $4 / $11, $4 / $18, status
+}'
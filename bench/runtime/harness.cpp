@@ -0,0 +1,86 @@
+// Times the kernels of kernels.cpp, built by 9cxx or by a C compiler.
+//
+// Usage: harness LABEL [ITERATIONS [REPEATS]]
+//
+// Each kernel is called ITERATIONS times per repetition. Prints one line per
+// kernel: the label, the kernel name, the minimum, median, mean and standard
+// deviation of nanoseconds per call over the repetitions, and a checksum of the
+// results which must agree between builds.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+extern "C" {
+int k_poly(int x, int y, int z);
+int k_cse(int x, int y, int z);
+int k_calls(int x, int y, int z);
+int k_args8(int x, int y, int z);
+int k_locals(int x, int y, int z);
+int k_compare(int x, int y, int z);
+int k_char(int x, int y, int z);
+}
+
+namespace {
+
+struct Kernel {
+  const char* name;
+  int (*fn)(int, int, int);
+};
+
+const Kernel kKernels[] = {
+  {"poly", k_poly},
+  {"cse", k_cse},
+  {"calls", k_calls},
+  {"args8", k_args8},
+  {"locals", k_locals},
+  {"compare", k_compare},
+  {"char", k_char},
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s LABEL [ITERATIONS [REPEATS]]\n", argv[0]);
+    return 1;
+  }
+  const char* label = argv[1];
+  int iterations = argc > 2 ? atoi(argv[2]) : 1000000;
+  int repeats = argc > 3 ? atoi(argv[3]) : 11;
+
+  for (const auto& kernel : kKernels) {
+    std::vector<double> ns_per_call;
+    unsigned checksum = 0;
+    for (int r = 0; r < repeats; ++r) {
+      unsigned sum = 0;
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < iterations; ++i) {
+        sum = sum * 31 + kernel.fn(i, i ^ 0x5a5a, (i >> 3) - 100);
+      }
+      std::chrono::duration<double, std::nano> elapsed =
+          std::chrono::steady_clock::now() - start;
+      ns_per_call.push_back(elapsed.count() / iterations);
+      checksum = sum;
+    }
+
+    std::sort(ns_per_call.begin(), ns_per_call.end());
+    double mean = 0;
+    for (auto ns : ns_per_call) {
+      mean += ns;
+    }
+    mean /= ns_per_call.size();
+    double variance = 0;
+    for (auto ns : ns_per_call) {
+      variance += (ns - mean) * (ns - mean);
+    }
+    variance /= ns_per_call.size();
+    printf("%s %s %.3f %.3f %.3f %.3f %08x\n", label, kernel.name,
+           ns_per_call.front(), ns_per_call[ns_per_call.size() / 2], mean,
+           std::sqrt(variance), checksum);
+  }
+  return 0;
+}
@@ -0,0 +1,41 @@
+int sq(int v){v*v;}
+int add3(int a,int b,int c){a+b+c;}
+int sum8(int a,int b,int c,int d,int e,int f,int g,int h){a+b*2+c*3+d*4+e*5+f*6+g*7+h*8;}
+
+int k_poly(int x,int y,int z){
+  int r;
+  r=x*x*x+3*x*x*y-7*x*y*z+y*y*z+11*z;
+  r*r-r*x+y;
+}
+
+int k_cse(int x,int y,int z){
+  (x*y+z)*(x*y+z)+(x*y-z)*(x*y+z)+(y*z+x)*(x*y-z)+(y*z+x)*(y*z+x);
+}
+
+int k_calls(int x,int y,int z){
+  add3(sq(x),sq(y),sq(z))+add3(sq(x+1),sq(y+1),sq(z+1))+sq(add3(x,y,z));
+}
+
+int k_args8(int x,int y,int z){
+  sum8(x,y,z,x+y,y+z,z+x,x*y,y*z)+sum8(z,y,x,1,2,3,4,5);
+}
+
+int k_locals(int x,int y,int z){
+  int a,b,c,r;
+  a=x+y;b=y+z;c=z+x;r=a*b+c;
+  {int t;t=a*c-b;r=r+t;}
+  {int u,v;u=r-a;v=u*b;r=r+v-c;}
+  {int w;w=r*a+b*c;r=r-w;}
+  r;
+}
+
+int k_compare(int x,int y,int z){
+  (x==y)+(y!=z)*2+(x==z)*4+(x+y==z)*8+(x*2!=y)*16+((x==y)==(y==z))*32;
+}
+
+int k_char(int x,int y,int z){
+  char a,b;
+  a=x*7+y;
+  b=y*3-z;
+  a*b+(a+b)*x;
+}
@@ -0,0 +1,35 @@
+#!/bin/bash -e
+#
+# Measures how code generation scales with the number of jobs (-j).
+#
+# Usage: bench/scaling.sh [NUM_FUNCTIONS [JOBS...]]
+
+CXX=$(dirname $0)/../src/9cxx
+NUM_FUNCTIONS=${1:-2000}
+shift || true
+JOBS=${@:-1 2 4 8}
+
+SRC=$(mktemp)
+trap "rm -f $SRC $SRC.s" EXIT
+
+awk -v n=$NUM_FUNCTIONS 'BEGIN {
+  for (i = 0; i < n; ++i) {
+    printf "int f%d(int a,int b){int x,y;x=a*b+%d;y=x*x+a*b;{char c;c=y;x=c+y*2;}x+y;}\n", i, i
+  }
+  printf "int main(){0;}\n"
+}' > $SRC
+
+echo "functions: $NUM_FUNCTIONS, source bytes: $(wc -c < $SRC)"
+
+TIMEFORMAT=%R
+BASE=""
+for j in $JOBS
+do
+  SECONDS_TAKEN=$( { time $CXX -j $j < $SRC > $SRC.s 2>/dev/null; } 2>&1 )
+  if [ -z "$BASE" ]
+  then
+    BASE=$SECONDS_TAKEN
+  fi
+  SPEEDUP=$(awk -v b=$BASE -v t=$SECONDS_TAKEN 'BEGIN { printf "%.2f", b / t }')
+  echo "-j $j: ${SECONDS_TAKEN}s (x$SPEEDUP)"
+done
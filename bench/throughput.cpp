@@ -0,0 +1,306 @@
+// Measures the compile throughput of 9cxx on generated programs.
+//
+// Usage: throughput [--scale N] [--repeat N] [--baseline FILE] [--threshold PCT]
+//
+// Each workload is compiled --repeat times in a child process, and the fastest
+// run is reported. The results are written to stdout as a JSON array. With
+// --baseline, the rates and the peak memory are compared against a previous
+// output, and the exit status is 1 if any of them got worse by more than
+// --threshold percent.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../src/compiler.hpp"
+
+namespace {
+
+// Generates the same source for the same seed on every platform, so it uses
+// the engine's output directly rather than a distribution.
+class Generator {
+ public:
+  explicit Generator(uint32_t seed) : engine_{seed} {
+  }
+
+  int Int(int max) {
+    return engine_() % max;
+  }
+
+  // Returns an expression of the given depth over the names in vars.
+  std::string Expression(const std::vector<std::string>& vars, int depth) {
+    if (depth == 0) {
+      return Int(3) == 0 ? std::to_string(Int(100)) : vars[Int(vars.size())];
+    }
+    static const char* const kOps[] = {"+", "-", "*", "==", "!="};
+    auto lhs = Expression(vars, depth - 1);
+    auto rhs = Expression(vars, Int(depth));
+    return "(" + lhs + kOps[Int(5)] + rhs + ")";
+  }
+
+ private:
+  std::mt19937 engine_;
+};
+
+const std::vector<std::string> kParams{"a", "b", "c"};
+
+// Many small functions.
+std::string ManyFunctions(int scale) {
+  Generator gen{1};
+  std::ostringstream src;
+  for (int i = 0; i < scale * 20; ++i) {
+    src << "int f" << i << "(int a,int b,int c){int x;x="
+        << gen.Expression(kParams, 3) << ";x-" << gen.Expression(kParams, 2)
+        << ";}\n";
+  }
+  src << "int main(){f0(1,2,3);}\n";
+  return src.str();
+}
+
+// A few functions with deeply nested expressions.
+std::string DeepExpressions(int scale) {
+  Generator gen{2};
+  std::ostringstream src;
+  for (int i = 0; i < 4; ++i) {
+    src << "int f" << i << "(int a,int b,int c){";
+    for (int j = 0; j < scale; ++j) {
+      src << gen.Expression(kParams, 12) << ";\n";
+    }
+    src << "}\n";
+  }
+  src << "int main(){f0(1,2,3);}\n";
+  return src.str();
+}
+
+// Functions with many locals in nested blocks.
+std::string ManyLocals(int scale) {
+  Generator gen{3};
+  std::ostringstream src;
+  for (int i = 0; i < 8; ++i) {
+    src << "int f" << i << "(int a,int b,int c){int r;r=0;";
+    std::vector<std::string> vars{kParams};
+    for (int j = 0; j < scale * 4; ++j) {
+      auto name = "v" + std::to_string(j);
+      src << (gen.Int(2) ? "int " : "char ") << name << ";" << name << "="
+          << gen.Expression(vars, 2) << ";";
+      vars.push_back(name);
+      if (j % 8 == 7) {
+        src << "{int t;t=" << gen.Expression(vars, 2) << ";r=r+t;}\n";
+      }
+    }
+    src << "r;}\n";
+  }
+  src << "int main(){f0(1,2,3);}\n";
+  return src.str();
+}
+
+// Functions calling the ones before them with many arguments.
+std::string ManyCalls(int scale) {
+  Generator gen{4};
+  std::ostringstream src;
+  src << "int g0(int a,int b,int c,int d,int e,int f,int g,int h){a+h;}\n";
+  for (int i = 1; i < scale * 10; ++i) {
+    src << "int g" << i << "(int a,int b,int c){";
+    for (int j = 0; j < 4; ++j) {
+      src << "g" << gen.Int(i) << "(";
+      int num_args = i == 1 ? 8 : 3;
+      for (int k = 0; k < num_args; ++k) {
+        src << (k ? "," : "") << gen.Expression(kParams, 1);
+      }
+      src << ")" << (j < 3 ? "+" : ";");
+    }
+    src << "}\n";
+  }
+  src << "int main(){g1(1,2,3);}\n";
+  return src.str();
+}
+
+struct Workload {
+  const char* name;
+  std::function<std::string(int)> generate;
+};
+
+const Workload kWorkloads[] = {
+  {"many_functions", ManyFunctions},
+  {"deep_expressions", DeepExpressions},
+  {"many_locals", ManyLocals},
+  {"many_calls", ManyCalls},
+};
+
+// Discards the assembly.
+class NullBuffer : public std::streambuf {
+ protected:
+  int overflow(int c) override {
+    return c;
+  }
+  std::streamsize xsputn(const char*, std::streamsize n) override {
+    return n;
+  }
+};
+
+// Compiles src repeat times in a child process, so that the peak memory is of
+// this workload alone. Returns the JSON object of the fastest run.
+std::string Measure(const std::string& src, int repeat) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    perror("pipe");
+    exit(2);
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    CompileStats best;
+    double best_seconds = -1;
+    for (int i = 0; i < repeat; ++i) {
+      NullBuffer null_buffer;
+      std::ostream out{&null_buffer};
+      std::ostringstream err;
+      CompileStats stats;
+      if (Compile(src, out, err, CompileOptions{}, nullptr, &stats) != 0) {
+        std::cerr << err.str();
+        _exit(1);
+      }
+      double seconds = stats.tokenize_seconds + stats.parse_seconds +
+                       stats.codegen_seconds + stats.emit_seconds;
+      if (best_seconds < 0 || seconds < best_seconds) {
+        best = stats;
+        best_seconds = seconds;
+      }
+    }
+    std::ostringstream json;
+    WriteStatsJson(best, json);
+    auto s = json.str();
+    _exit(write(fds[1], s.data(), s.size()) == ssize_t(s.size()) ? 0 : 1);
+  }
+
+  close(fds[1]);
+  std::string json;
+  char buf[4096];
+  for (ssize_t n; (n = read(fds[0], buf, sizeof(buf))) > 0; ) {
+    json.append(buf, n);
+  }
+  close(fds[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    std::cerr << "compile failed" << std::endl;
+    exit(2);
+  }
+  return json;
+}
+
+// Reads the numbers in an output of this program, by workload and key.
+std::map<std::string, std::map<std::string, double>> ReadResults(
+    std::istream& in) {
+  std::map<std::string, std::map<std::string, double>> results;
+  std::regex name_re{R"re("name": "(\w+)")re"};
+  std::regex number_re{R"re("(\w+)": ([-0-9.e+]+))re"};
+  for (std::string line; std::getline(in, line); ) {
+    std::smatch m;
+    if (!std::regex_search(line, m, name_re)) {
+      continue;
+    }
+    auto& values = results[m[1]];
+    for (std::sregex_iterator it{line.begin(), line.end(), number_re}, end;
+         it != end; ++it) {
+      values[(*it)[1]] = std::stod((*it)[2]);
+    }
+  }
+  return results;
+}
+
+// Prints the change of each metric from baseline to current. Returns false if
+// any of them regressed by more than threshold percent.
+bool Compare(const std::map<std::string, std::map<std::string, double>>& baseline,
+             const std::map<std::string, std::map<std::string, double>>& current,
+             double threshold) {
+  // Higher is better for the rates, and lower is better for memory.
+  const std::pair<const char*, bool> kMetrics[] = {
+    {"tokens_per_second", true},
+    {"nodes_per_second", true},
+    {"lines_per_second", true},
+    {"peak_rss_kb", false},
+  };
+  bool ok = true;
+  for (const auto& [name, values] : current) {
+    auto base = baseline.find(name);
+    if (base == baseline.end()) {
+      continue;
+    }
+    for (const auto& [metric, higher_is_better] : kMetrics) {
+      auto b = base->second.find(metric), c = values.find(metric);
+      if (b == base->second.end() || c == values.end() || b->second == 0) {
+        continue;
+      }
+      double change = (c->second - b->second) / b->second * 100;
+      bool regressed = higher_is_better ? change < -threshold
+                                        : change > threshold;
+      fprintf(stderr, "%-18s %-18s %14.1f %14.1f %+8.1f%%%s\n",
+              name.c_str(), metric, b->second, c->second, change,
+              regressed ? "  REGRESSION" : "");
+      ok = ok && !regressed;
+    }
+  }
+  return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  int scale = 50, repeat = 5;
+  double threshold = 10;
+  std::string baseline_path;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--scale" && i + 1 < argc) {
+      scale = std::max(atoi(argv[++i]), 1);
+    } else if (arg == "--repeat" && i + 1 < argc) {
+      repeat = std::max(atoi(argv[++i]), 1);
+    } else if (arg == "--baseline" && i + 1 < argc) {
+      baseline_path = argv[++i];
+    } else if (arg == "--threshold" && i + 1 < argc) {
+      threshold = atof(argv[++i]);
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--scale N] [--repeat N]"
+                << " [--baseline FILE] [--threshold PCT]" << std::endl;
+      return 2;
+    }
+  }
+
+  std::ostringstream out;
+  out << "[\n";
+  for (const auto& workload : kWorkloads) {
+    auto src = workload.generate(scale);
+    auto json = Measure(src, repeat);
+    out << "  {\"name\": \"" << workload.name << "\", \"source_lines\": "
+        << std::count(src.begin(), src.end(), '\n') << ", \"stats\": " << json
+        << "}" << (&workload == std::end(kWorkloads) - 1 ? "\n" : ",\n");
+  }
+  out << "]\n";
+  std::cout << out.str();
+
+  if (baseline_path.empty()) {
+    return 0;
+  }
+  std::ifstream baseline_in{baseline_path};
+  auto baseline = ReadResults(baseline_in);
+  if (baseline.empty()) {
+    std::cerr << "Cannot read " << baseline_path << std::endl;
+    return 2;
+  }
+  std::istringstream current_in{out.str()};
+  auto current = ReadResults(current_in);
+  return Compare(baseline, current, threshold) ? 0 : 1;
+}
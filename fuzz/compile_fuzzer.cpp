@@ -0,0 +1,45 @@
+// libFuzzer entry point which compiles each input as a translation unit,
+// running the tokenizer, the parser and the code generator on it. Inputs
+// which are not valid programs must be rejected with diagnostics, never crash.
+//
+// Build with `make fuzz` in src, which needs clang for -fsanitize=fuzzer, and
+// run as:
+//
+//   ../fuzz/compile_fuzzer CORPUS_DIR
+//
+// `differential --corpus CORPUS_DIR` writes generated programs to start from.
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+#include "../src/compiler.hpp"
+
+namespace {
+
+class NullBuffer : public std::streambuf {
+ protected:
+  int overflow(int c) override {
+    return c;
+  }
+  std::streamsize xsputn(const char*, std::streamsize n) override {
+    return n;
+  }
+};
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  std::string src{reinterpret_cast<const char*>(data), size};
+  NullBuffer null_buffer;
+  std::ostream null{&null_buffer};
+  // The default is non-PIC code; -fPIE takes other paths of code generation.
+  for (auto pic_mode : {PicMode::kNone, PicMode::kPie}) {
+    CompileOptions options;
+    options.pic_mode = pic_mode;
+    Compile(src, null, null, options);
+  }
+  return 0;
+}
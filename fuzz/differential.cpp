@@ -0,0 +1,227 @@
+// Compares the exit codes of generated programs compiled by 9cxx with those of
+// the same programs in C compiled by a reference compiler.
+//
+// Usage: differential [-n N] [--seed S] [-j N] [--keep] [--corpus DIR]
+//
+// Program i is generated from seed S + i. Each is compiled in process, then
+// assembled, linked and run, as non-PIC code in a non-PIE executable and again
+// with -fPIE. Its C version is compiled with $CC (clang by default) and run.
+// The seeds of programs whose exit codes differ, or which 9cxx fails to
+// compile, are printed; with --keep, their files are left in a temporary
+// directory. At the end, the number of programs checked per second is printed
+// with the time each step takes, as the pipeline should stay fast enough to
+// run continuously.
+//
+// With --corpus, the programs are written to DIR instead, as a corpus to start
+// compile_fuzzer with.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "../src/compiler.hpp"
+#include "../src/thread_pool.hpp"
+#include "../test/harness.hpp"
+#include "generator.hpp"
+
+namespace {
+
+// The steps of checking a program, whose times are reported.
+enum Step {
+  kGenerate,
+  kCompile,
+  kAssemble,
+  kLink,
+  kRun,
+  kReference,
+  kRunReference,
+  kNumSteps,
+};
+
+const char* const kStepNames[] = {
+  "generate", "9cxx", "nasm", "link", "run", "reference", "run-reference",
+};
+
+struct Result {
+  bool ok;
+  std::string message;
+  double seconds[kNumSteps];
+};
+
+Result Check(uint64_t seed, const std::string& cc, bool keep) {
+  Result result{true, "", {}};
+  auto start = std::chrono::steady_clock::now();
+  // Adds the seconds since the previous call to step.
+  auto lap = [&](Step step) {
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = now - start;
+    result.seconds[step] += elapsed.count();
+    start = now;
+  };
+
+  auto program = GenerateProgram(seed);
+  lap(kGenerate);
+
+  char dir_template[] = "/tmp/9cxx-diff.XXXXXX";
+  if (!mkdtemp(dir_template)) {
+    return {false, "Cannot create a temporary directory", {}};
+  }
+  std::string dir = dir_template;
+  auto src_path = dir + "/program.cpp";
+  auto ref_path = dir + "/reference.c", ref_exe_path = dir + "/reference";
+  std::ofstream{src_path} << program.source;
+  std::ofstream{ref_path} << program.reference;
+  std::vector<std::string> paths{src_path, ref_path, ref_exe_path};
+
+  int compiled = Run({cc, "-x", "c", "-fwrapv", "-w", ref_path,
+                      "-o", ref_exe_path});
+  lap(kReference);
+  int expected = compiled == 0 ? Run({ref_exe_path}) : -1;
+  lap(kRunReference);
+  if (compiled != 0) {
+    result.message = "The reference compiler failed";
+  }
+
+  // The files of each pass are named after its option.
+  for (const auto& pass : kPasses) {
+    if (!result.message.empty()) {
+      break;
+    }
+    std::string in_pass = *pass.option ? std::string{" with "} + pass.option
+                                       : "";
+    CompileOptions options;
+    options.leading_underscore = kLeadingUnderscore;
+    options.pic_mode = pass.pic_mode;
+    std::ostringstream code, err;
+    int compile_code = Compile(program.source, code, err, options);
+    lap(kCompile);
+    if (compile_code != 0) {
+      result.message = "9cxx failed" + in_pass + ": " + err.str();
+      break;
+    }
+
+    auto exe_path = dir + "/program" + pass.option;
+    auto s_path = exe_path + ".s", o_path = exe_path + ".o";
+    paths.insert(paths.end(), {s_path, o_path, exe_path});
+    std::ofstream{s_path} << code.str();
+    int assembled = Run({"nasm", s_path, "-f", kFormat, "-o", o_path});
+    lap(kAssemble);
+    std::vector<std::string> link{"clang++", o_path};
+    link.insert(link.end(), pass.link_flags.begin(), pass.link_flags.end());
+    link.insert(link.end(), {"-o", exe_path});
+    int linked = assembled == 0 ? Run(link) : -1;
+    lap(kLink);
+    int actual = linked == 0 ? Run({exe_path}) : -1;
+    lap(kRun);
+
+    if (assembled != 0) {
+      result.message = "nasm failed" + in_pass;
+    } else if (linked != 0) {
+      result.message = "Link failed" + in_pass;
+    } else if (actual != expected) {
+      result.message = "Exit code " + std::to_string(actual) + in_pass +
+                       ", reference " + std::to_string(expected);
+    }
+  }
+  result.ok = result.message.empty();
+
+  if (result.ok || !keep) {
+    for (const auto& path : paths) {
+      unlink(path.c_str());
+    }
+    rmdir(dir.c_str());
+  } else {
+    result.message += "\n  Files kept in " + dir;
+  }
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  size_t num_programs = 100;
+  uint64_t first_seed = 1;
+  size_t num_jobs = std::max(std::thread::hardware_concurrency(), 1u);
+  bool keep = false;
+  std::string corpus_dir;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-n" && i + 1 < argc) {
+      num_programs = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--seed" && i + 1 < argc) {
+      first_seed = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "-j" && i + 1 < argc) {
+      num_jobs = std::max(atoi(argv[++i]), 1);
+    } else if (arg == "--keep") {
+      keep = true;
+    } else if (arg == "--corpus" && i + 1 < argc) {
+      corpus_dir = argv[++i];
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [-n N] [--seed S] [-j N] [--keep]"
+                << " [--corpus DIR]" << std::endl;
+      return 2;
+    }
+  }
+
+  if (!corpus_dir.empty()) {
+    for (size_t i = 0; i < num_programs; ++i) {
+      auto seed = first_seed + i;
+      std::ofstream out{corpus_dir + "/" + std::to_string(seed) + ".cpp"};
+      if (!(out << GenerateProgram(seed).source)) {
+        std::cerr << "Cannot write to " << corpus_dir << std::endl;
+        return 2;
+      }
+    }
+    return 0;
+  }
+
+  std::string cc = "clang";
+  if (auto env = std::getenv("CC")) {
+    cc = env;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<Result> results(num_programs);
+  ThreadPool pool{num_jobs};
+  for (size_t i = 0; i < num_programs; ++i) {
+    pool.Submit([&, i] {
+      results[i] = Check(first_seed + i, cc, keep);
+    });
+  }
+  pool.Wait();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  size_t num_failed = 0;
+  double step_seconds[kNumSteps] = {};
+  for (size_t i = 0; i < num_programs; ++i) {
+    if (!results[i].ok) {
+      printf("[FAILED] seed %llu: %s\n",
+             static_cast<unsigned long long>(first_seed + i),
+             results[i].message.c_str());
+      ++num_failed;
+    }
+    for (int step = 0; step < kNumSteps; ++step) {
+      step_seconds[step] += results[i].seconds[step];
+    }
+  }
+
+  printf("%zu passed, %zu failed in %.2f s on %zu threads: %.1f execs/s\n",
+         num_programs - num_failed, num_failed, elapsed.count(), num_jobs,
+         num_programs / elapsed.count());
+  printf("ms per program:");
+  for (int step = 0; step < kNumSteps; ++step) {
+    printf(" %s %.2f", kStepNames[step],
+           1000 * step_seconds[step] / std::max<size_t>(num_programs, 1));
+  }
+  printf("\n");
+  return num_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,301 @@
+#include "generator.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// The precedence of the expressions an operator makes, so that operands of
+// lower precedence are put in parentheses.
+const int kEquality = 1;
+const int kAdditive = 2;
+const int kMultiplicative = 3;
+const int kPrimary = 4;
+
+struct Variable {
+  std::string name;
+  bool is_char;
+};
+
+struct Function {
+  std::string name;
+  size_t num_params;
+  bool writes_globals;
+};
+
+struct Expression {
+  std::string text;
+  int precedence;
+};
+
+// A statement in both languages.
+struct Statement {
+  std::string source, reference;
+};
+
+class Generator {
+ public:
+  Generator(uint64_t seed, const GeneratorOptions& options)
+      : random_{seed}, options_{options} {
+  }
+
+  GeneratedProgram Generate() {
+    GeneratedProgram program;
+    for (size_t i = Uniform(0, options_.max_globals); i > 0; --i) {
+      auto text = Global();
+      program.source += text;
+      program.reference += text;
+    }
+    for (size_t i = Uniform(0, options_.max_functions); i > 0; --i) {
+      FunctionDefinition("f" + std::to_string(functions_.size()), program);
+    }
+    FunctionDefinition("main", program);
+    return program;
+  }
+
+ private:
+  size_t Uniform(size_t lo, size_t hi) {
+    return std::uniform_int_distribution<size_t>{lo, hi}(random_);
+  }
+
+  bool Chance(size_t percent) {
+    return Uniform(0, 99) < percent;
+  }
+
+  template <typename T>
+  const T& Pick(const std::vector<T>& items) {
+    return items[Uniform(0, items.size() - 1)];
+  }
+
+  std::string Type(bool is_char) {
+    return is_char ? "char" : "int";
+  }
+
+  std::string Global() {
+    Variable var{"g" + std::to_string(globals_.size()), Chance(30)};
+    std::string text = Chance(30) ? "static " : "";
+    text += Type(var.is_char) + " " + var.name;
+    if (Chance(70)) {
+      // Initializers at namespace scope are constant expressions.
+      text += " = " + Expr(options_.max_expression_depth).text;
+    }
+    globals_.push_back(var);
+    return text + ";\n";
+  }
+
+  void FunctionDefinition(const std::string& name, GeneratedProgram& program) {
+    bool is_main = name == "main";
+    Function fn{name, is_main ? 0 : Uniform(0, options_.max_params),
+                is_main || (!globals_.empty() && Chance(30))};
+    writes_globals_ = fn.writes_globals;
+    num_locals_ = 0;
+    scopes_.assign(1, {});
+
+    std::string head = !is_main && Chance(30) ? "static int " : "int ";
+    head += name + "(";
+    for (size_t i = 0; i < fn.num_params; ++i) {
+      Variable param{"p" + std::to_string(i), Chance(30)};
+      head += (i > 0 ? ", " : "") + Type(param.is_char) + " " + param.name;
+      scopes_.back().push_back(param);
+    }
+    head += ") {\n";
+
+    // The parameters are in the scope of the body, as in C.
+    auto body = Statements(0);
+    auto last = Expr(options_.max_expression_depth).text;
+    program.source += head + body.source + "  " + last + ";\n}\n";
+    program.reference += head + body.reference + "  return " + last + ";\n}\n";
+    functions_.push_back(fn);
+  }
+
+  Statement Statements(size_t depth) {
+    Statement block;
+    std::string indent(2 * depth + 2, ' ');
+    for (size_t i = Uniform(0, options_.max_statements - 1); i > 0; --i) {
+      auto stmt = AnyStatement(depth);
+      block.source += indent + stmt.source + "\n";
+      block.reference += indent + stmt.reference + "\n";
+    }
+    return block;
+  }
+
+  Statement AnyStatement(size_t depth) {
+    auto kind = Uniform(0, 99);
+    if (kind < 30) {
+      return Declaration();
+    } else if (kind < 55) {
+      if (auto targets = Visible(writes_globals_); !targets.empty()) {
+        auto text = Pick(targets).name + " = " +
+                    Expr(options_.max_expression_depth).text + ";";
+        return {text, text};
+      }
+    } else if (kind < 70 && depth < options_.max_block_depth) {
+      scopes_.emplace_back();
+      auto block = Statements(depth + 1);
+      scopes_.pop_back();
+      std::string indent(2 * depth + 2, ' ');
+      return {"{\n" + block.source + indent + "}",
+              "{\n" + block.reference + indent + "}"};
+    } else if (kind < 85 && writes_globals_) {
+      std::vector<Function> callees;
+      for (const auto& fn : functions_) {
+        if (fn.writes_globals) {
+          callees.push_back(fn);
+        }
+      }
+      if (!callees.empty()) {
+        auto call = Call(Pick(callees), options_.max_expression_depth);
+        auto targets = Visible(true);
+        if (!targets.empty() && Chance(50)) {
+          call = Pick(targets).name + " = " + call;
+        }
+        return {call + ";", call + ";"};
+      }
+    }
+    auto text = Expr(options_.max_expression_depth).text + ";";
+    return {text, text};
+  }
+
+  Statement Declaration() {
+    bool is_char = Chance(30);
+    std::string text = Type(is_char) + " ";
+    for (size_t i = Uniform(1, 2); i > 0; --i) {
+      // Sometimes a name of an outer block is declared again. Its initializer
+      // may not use the outer variable, as in C the new one is in scope there.
+      std::vector<Variable> outer;
+      for (size_t k = 0; k + 1 < scopes_.size(); ++k) {
+        outer.insert(outer.end(), scopes_[k].begin(), scopes_[k].end());
+      }
+      Variable var{"v" + std::to_string(num_locals_), is_char};
+      if (!outer.empty() && Chance(20)) {
+        var.name = Pick(outer).name;
+        for (const auto& local : scopes_.back()) {
+          if (local.name == var.name) {
+            var.name = "v" + std::to_string(num_locals_);
+          }
+        }
+      }
+      if (var.name == "v" + std::to_string(num_locals_)) {
+        ++num_locals_;
+      }
+      excluded_ = var.name;
+      text += var.name + " = " + Expr(options_.max_expression_depth).text;
+      excluded_.clear();
+      text += i > 1 ? ", " : ";";
+      scopes_.back().push_back(var);
+    }
+    return {text, text};
+  }
+
+  // Returns the variables which an expression can refer to, innermost first.
+  // Globals are included for reading, or if writable is true.
+  std::vector<Variable> Visible(bool writable_globals) {
+    std::vector<Variable> vars;
+    auto shadowed = [&](const std::string& name) {
+      for (const auto& var : vars) {
+        if (var.name == name) {
+          return true;
+        }
+      }
+      return name == excluded_;
+    };
+    for (auto scope = scopes_.rbegin(); scope != scopes_.rend(); ++scope) {
+      for (const auto& var : *scope) {
+        if (!shadowed(var.name)) {
+          vars.push_back(var);
+        }
+      }
+    }
+    if (writable_globals) {
+      vars.insert(vars.end(), globals_.begin(), globals_.end());
+    }
+    return vars;
+  }
+
+  std::string Call(const Function& fn, size_t depth) {
+    std::string text = fn.name + "(";
+    for (size_t i = 0; i < fn.num_params; ++i) {
+      text += (i > 0 ? ", " : "") + Expr(depth - 1).text;
+    }
+    return text + ")";
+  }
+
+  Expression Literal(size_t max) {
+    return {std::to_string(Uniform(0, max)), kPrimary};
+  }
+
+  // Returns an expression which refers to no variables while generating a
+  // global, and which calls only functions which do not assign globals.
+  Expression Expr(size_t depth) {
+    bool in_function = !scopes_.empty();
+    if (depth == 0 || Chance(25)) {
+      if (in_function && Chance(60)) {
+        auto vars = Visible(true);
+        if (!vars.empty()) {
+          return {Pick(vars).name, kPrimary};
+        }
+      }
+      return Literal(Chance(80) ? 20 : 1000000);
+    }
+
+    auto kind = Uniform(0, 99);
+    if (kind < 15 && in_function) {
+      std::vector<Function> callees;
+      for (const auto& fn : functions_) {
+        if (!fn.writes_globals) {
+          callees.push_back(fn);
+        }
+      }
+      if (!callees.empty()) {
+        return {Call(Pick(callees), depth), kPrimary};
+      }
+    } else if (kind < 20) {
+      return {"(" + Expr(depth - 1).text + ")", kPrimary};
+    } else if (kind < 30) {
+      // A nonzero literal divisor cannot divide by zero or overflow.
+      auto lhs = Expr(depth - 1);
+      auto divisor = std::to_string(Uniform(1, 9));
+      return {Operand(lhs, kMultiplicative, false) + " / " + divisor,
+              kMultiplicative};
+    }
+
+    const char* ops[] = {"+", "-", "*", "==", "!="};
+    const int precedences[] = {
+      kAdditive, kAdditive, kMultiplicative, kEquality, kEquality,
+    };
+    auto i = Uniform(0, 4);
+    auto lhs = Expr(depth - 1), rhs = Expr(depth - 1);
+    return {Operand(lhs, precedences[i], false) + " " + ops[i] + " " +
+            Operand(rhs, precedences[i], true), precedences[i]};
+  }
+
+  // Returns the text of an operand of an operator of the given precedence,
+  // with parentheses if needed. All operators are left associative.
+  std::string Operand(const Expression& exp, int precedence, bool is_rhs) {
+    if (exp.precedence < precedence ||
+        (is_rhs && exp.precedence == precedence)) {
+      return "(" + exp.text + ")";
+    }
+    return exp.text;
+  }
+
+  std::mt19937_64 random_;
+  GeneratorOptions options_;
+  std::vector<Variable> globals_;
+  std::vector<Function> functions_;
+  // The blocks of the function being generated, innermost last. The first
+  // holds the parameters as well.
+  std::vector<std::vector<Variable>> scopes_;
+  size_t num_locals_ = 0;
+  bool writes_globals_ = false;
+  // A name which expressions may not refer to.
+  std::string excluded_;
+};
+
+} // namespace
+
+GeneratedProgram GenerateProgram(uint64_t seed,
+                                 const GeneratorOptions& options) {
+  return Generator{seed, options}.Generate();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A random program in the language which 9cxx compiles, and the same program
+// in C to compile with another compiler as a reference.
+struct GeneratedProgram {
+  std::string source;
+  // Each function returns the value of its last statement explicitly. Compile
+  // with -fwrapv, as int arithmetic in 9cxx wraps around.
+  std::string reference;
+};
+
+struct GeneratorOptions {
+  size_t max_globals = 4;
+  size_t max_functions = 5;
+  size_t max_params = 4;
+  size_t max_statements = 6; // in each block
+  size_t max_block_depth = 2;
+  size_t max_expression_depth = 3;
+};
+
+// Generates a program from seed, the same one each time for the same seed and
+// options. The programs use globals, static and external functions with int
+// and char parameters, nested blocks with shadowing, and all the operators.
+//
+// Their behavior is defined, so that the exit codes of both programs must be
+// equal: variables are initialized where they are declared, divisors are
+// nonzero literals, functions only call functions defined before them, and
+// evaluating an expression has no side effects. Functions which assign
+// globals are only called as a whole statement or as the right side of an
+// assignment statement.
+GeneratedProgram GenerateProgram(uint64_t seed,
+                                 const GeneratorOptions& options = {});
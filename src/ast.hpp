@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <memory>
+#include "type.hpp"
 
 struct ASTNode;
 struct TranslationUnit;
@@ -21,6 +22,7 @@ struct BlockDeclaration;
 struct SimpleDeclaration;
 struct DeclSpecifier;
 struct SimpleTypeSpecifier;
+struct StorageClassSpecifier;
 struct InitDeclarator;
 struct Initializer;
 struct EqualInitializer;
@@ -49,6 +51,7 @@ class Visitor {
   virtual void Visit(Identifier* exp, bool lvalue) = 0;
   virtual void Visit(SimpleDeclaration* decl, bool lvalue) = 0;
   virtual void Visit(SimpleTypeSpecifier* spec, bool lvalue) = 0;
+  virtual void Visit(StorageClassSpecifier* spec, bool lvalue) = 0;
   virtual void Visit(InitDeclarator* dtor, bool lvalue) = 0;
   virtual void Visit(EqualInitializer* init, bool lvalue) = 0;
   virtual void Visit(InitializerClause* clause, bool lvalue) = 0;
@@ -138,6 +141,8 @@ struct Identifier : public Expression {
 };
 
 struct Declaration : public ASTNode {
+  // Tokens [token_begin, token_end) of a declaration at namespace scope.
+  size_t token_begin = 0, token_end = 0;
 };
 
 struct BlockDeclaration : public Declaration {
@@ -154,6 +159,12 @@ struct DeclSpecifier : public ASTNode {
 
 struct SimpleTypeSpecifier : public DeclSpecifier {
   std::string type;
+  const TypeInfo* type_info;
+  ACCEPT
+};
+
+struct StorageClassSpecifier : public DeclSpecifier {
+  std::string value; // "static"
   ACCEPT
 };
 
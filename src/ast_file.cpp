@@ -0,0 +1,511 @@
+#include "ast_file.hpp"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <iterator>
+#include <map>
+#include <ostream>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tokenizer.hpp"
+#include "ast.hpp"
+
+namespace {
+
+// Number of edges of each kind of node, in the order of AstNodeKind, or -1 if
+// it varies.
+const int kNumEdges[] = {
+  -1, // kTranslationUnit
+  -1, // kCompoundStatement
+  1,  // kExpressionStatement
+  1,  // kDeclarationStatement
+  2,  // kAssignmentExpression
+  2,  // kEqualityExpression
+  2,  // kAdditiveExpression
+  2,  // kMultiplicativeExpression
+  -1, // kFunctionCallExpression
+  0,  // kIntegerLiteral
+  0,  // kIdentifier
+  -1, // kSimpleDeclaration
+  0,  // kSimpleTypeSpecifier
+  0,  // kStorageClassSpecifier
+  2,  // kInitDeclarator
+  1,  // kEqualInitializer
+  1,  // kInitializerClause
+  1,  // kNoPtrDeclarator
+  2,  // kFunctionDeclarator
+  2,  // kParameterDeclaration
+  -1, // kParametersAndQualifiers
+  -1, // kFunctionDefinition
+};
+
+bool HasString(AstNodeKind kind) {
+  return kind == AstNodeKind::kIdentifier ||
+         kind == AstNodeKind::kSimpleTypeSpecifier ||
+         kind == AstNodeKind::kStorageClassSpecifier;
+}
+
+// Appends the nodes of an AST to the arrays of an AST file in pre-order.
+class AstWriteVisitor : public Visitor {
+ public:
+  void Visit(TranslationUnit* unit, bool lvalue) {
+    auto index = AddNode(AstNodeKind::kTranslationUnit, unit->decls.size());
+    AddChildren(index, 0, unit->decls);
+  }
+
+  void Visit(CompoundStatement* stmt, bool lvalue) {
+    auto index = AddNode(AstNodeKind::kCompoundStatement,
+                         stmt->statements.size());
+    AddChildren(index, 0, stmt->statements);
+  }
+
+  void Visit(ExpressionStatement* stmt, bool lvalue) {
+    auto index = AddNode(AstNodeKind::kExpressionStatement, 1);
+    AddChild(index, 0, stmt->exp.get());
+  }
+
+  void Visit(DeclarationStatement* stmt, bool lvalue) {
+    auto index = AddNode(AstNodeKind::kDeclarationStatement, 1);
+    AddChild(index, 0, stmt->decl.get());
+  }
+
+  void Visit(AssignmentExpression* exp, bool lvalue) {
+    AddBinary(AstNodeKind::kAssignmentExpression, exp);
+  }
+
+  void Visit(EqualityExpression* exp, bool lvalue) {
+    AddBinary(AstNodeKind::kEqualityExpression, exp);
+  }
+
+  void Visit(AdditiveExpression* exp, bool lvalue) {
+    AddBinary(AstNodeKind::kAdditiveExpression, exp);
+  }
+
+  void Visit(MultiplicativeExpression* exp, bool lvalue) {
+    AddBinary(AstNodeKind::kMultiplicativeExpression, exp);
+  }
+
+  void Visit(FunctionCallExpression* exp, bool lvalue) {
+    auto index = AddNode(AstNodeKind::kFunctionCallExpression,
+                         1 + exp->args.size());
+    AddChild(index, 0, exp->name.get());
+    AddChildren(index, 1, exp->args);
+  }
+
+  void Visit(IntegerLiteral* exp, bool lvalue) {
+    auto index = AddNode(AstNodeKind::kIntegerLiteral, 0);
+    nodes_[index].value = exp->value;
+  }
+
+  void Visit(Identifier* exp, bool lvalue) {
+    AddString(AstNodeKind::kIdentifier, exp->value);
+  }
+
+  void Visit(SimpleDeclaration* decl, bool lvalue) {
+    auto index = AddNode(AstNodeKind::kSimpleDeclaration,
+                         decl->specs.size() + decl->dtors.size());
+    nodes_[index].value = decl->specs.size();
+    AddChildren(index, 0, decl->specs);
+    AddChildren(index, decl->specs.size(), decl->dtors);
+  }
+
+  void Visit(SimpleTypeSpecifier* spec, bool lvalue) {
+    AddString(AstNodeKind::kSimpleTypeSpecifier, spec->type);
+  }
+
+  void Visit(StorageClassSpecifier* spec, bool lvalue) {
+    AddString(AstNodeKind::kStorageClassSpecifier, spec->value);
+  }
+
+  void Visit(InitDeclarator* dtor, bool lvalue) {
+    auto index = AddNode(AstNodeKind::kInitDeclarator, 2);
+    AddChild(index, 0, dtor->dtor.get());
+    AddChild(index, 1, dtor->init.get());
+  }
+
+  void Visit(EqualInitializer* init, bool lvalue) {
+    auto index = AddNode(AstNodeKind::kEqualInitializer, 1);
+    AddChild(index, 0, init->clause.get());
+  }
+
+  void Visit(InitializerClause* clause, bool lvalue) {
+    auto index = AddNode(AstNodeKind::kInitializerClause, 1);
+    AddChild(index, 0, clause->assign.get());
+  }
+
+  void Visit(NoPtrDeclarator* dtor, bool lvalue) {
+    auto index = AddNode(AstNodeKind::kNoPtrDeclarator, 1);
+    AddChild(index, 0, dtor->id.get());
+  }
+
+  void Visit(FunctionDeclarator* dtor, bool lvalue) {
+    auto index = AddNode(AstNodeKind::kFunctionDeclarator, 2);
+    AddChild(index, 0, dtor->decl.get());
+    AddChild(index, 1, dtor->param.get());
+  }
+
+  void Visit(ParameterDeclaration* decl, bool lvalue) {
+    auto index = AddNode(AstNodeKind::kParameterDeclaration, 2);
+    AddChild(index, 0, decl->spec.get());
+    AddChild(index, 1, decl->dtor.get());
+  }
+
+  void Visit(ParametersAndQualifiers* pq, bool lvalue) {
+    auto index = AddNode(AstNodeKind::kParametersAndQualifiers,
+                         pq->params.size());
+    nodes_[index].flags = pq->omit;
+    AddChildren(index, 0, pq->params);
+  }
+
+  void Visit(FunctionDefinition* defn, bool lvalue) {
+    auto index = AddNode(AstNodeKind::kFunctionDefinition,
+                         defn->specs.size() + 2);
+    nodes_[index].value = defn->specs.size();
+    AddChildren(index, 0, defn->specs);
+    AddChild(index, defn->specs.size(), defn->dtor.get());
+    AddChild(index, defn->specs.size() + 1, defn->body.get());
+  }
+
+  void Write(std::ostream& out) const {
+    AstFileHeader header{};
+    std::copy(std::begin(kAstFileMagic), std::end(kAstFileMagic),
+              header.magic);
+    header.version = kAstFileVersion;
+    header.num_nodes = nodes_.size();
+    header.num_edges = edges_.size();
+    header.strings_size = strings_.size();
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(nodes_.data()),
+              nodes_.size() * sizeof(AstFileNode));
+    out.write(reinterpret_cast<const char*>(edges_.data()),
+              edges_.size() * sizeof(uint32_t));
+    out.write(strings_.data(), strings_.size());
+    const char padding[4] = {};
+    out.write(padding, (4 - strings_.size() % 4) % 4);
+  }
+
+ private:
+  // Appends a node with num_edges absent children, and returns its index.
+  uint32_t AddNode(AstNodeKind kind, size_t num_edges) {
+    AstFileNode node{};
+    node.kind = kind;
+    node.first_edge = edges_.size();
+    node.num_edges = num_edges;
+    nodes_.push_back(node);
+    edges_.resize(edges_.size() + num_edges);
+    return nodes_.size() - 1;
+  }
+
+  void AddBinary(AstNodeKind kind, BinaryExpression* exp) {
+    auto index = AddNode(kind, 2);
+    nodes_[index].op = static_cast<uint8_t>(exp->op);
+    AddChild(index, 0, exp->lhs.get());
+    AddChild(index, 1, exp->rhs.get());
+  }
+
+  void AddString(AstNodeKind kind, const std::string& s) {
+    auto index = AddNode(kind, 0);
+    auto [it, inserted] = string_offsets_.emplace(s, strings_.size());
+    if (inserted) {
+      strings_.insert(strings_.end(), s.c_str(), s.c_str() + s.size() + 1);
+    }
+    nodes_[index].value = it->second;
+  }
+
+  // Adds child as the k-th child of the index-th node, if it is present.
+  void AddChild(uint32_t index, size_t k, ASTNode* child) {
+    if (child) {
+      edges_[nodes_[index].first_edge + k] = nodes_.size() - index;
+      child->Accept(this, false);
+    }
+  }
+
+  template <typename T>
+  void AddChildren(uint32_t index, size_t first_k,
+                   const std::vector<std::shared_ptr<T>>& children) {
+    for (size_t i = 0; i < children.size(); ++i) {
+      AddChild(index, first_k + i, children[i].get());
+    }
+  }
+
+  std::vector<AstFileNode> nodes_;
+  std::vector<uint32_t> edges_;
+  std::vector<char> strings_;
+  std::map<std::string, uint32_t> string_offsets_;
+};
+
+// Builds AST nodes from the nodes of a file. A child of an unexpected kind
+// makes the whole build fail.
+class AstBuilder {
+ public:
+  explicit AstBuilder(const AstFile& file) : file_{file} {
+  }
+
+  std::shared_ptr<TranslationUnit> Build() {
+    auto unit = Child<TranslationUnit>(0);
+    return ok_ ? unit : nullptr;
+  }
+
+ private:
+  // Builds the node at index, which must be of type T unless it is absent
+  // and optional.
+  template <typename T>
+  std::shared_ptr<T> Child(uint32_t index, bool optional = false) {
+    if (index == AstFile::kNoNode) {
+      ok_ = ok_ && optional;
+      return nullptr;
+    }
+    auto node = std::dynamic_pointer_cast<T>(BuildNode(index));
+    ok_ = ok_ && node;
+    return node;
+  }
+
+  template <typename T>
+  std::vector<std::shared_ptr<T>> Children(uint32_t index, uint32_t first_k,
+                                           uint32_t end_k) {
+    std::vector<std::shared_ptr<T>> children;
+    for (auto k = first_k; k < end_k; ++k) {
+      children.push_back(Child<T>(file_.Child(index, k)));
+    }
+    return children;
+  }
+
+  template <typename T>
+  std::shared_ptr<ASTNode> BuildBinary(uint32_t index) {
+    auto n = std::make_shared<T>();
+    n->op = static_cast<TokenType>(file_.Node(index).op);
+    n->lhs = Child<Expression>(file_.Child(index, 0));
+    n->rhs = Child<Expression>(file_.Child(index, 1));
+    return n;
+  }
+
+  std::shared_ptr<ASTNode> BuildNode(uint32_t index) {
+    const auto& node = file_.Node(index);
+    auto num_specs = std::min<uint32_t>(node.value, node.num_edges);
+    if (node.kind == AstNodeKind::kTranslationUnit) {
+      auto n = std::make_shared<TranslationUnit>();
+      n->decls = Children<Declaration>(index, 0, node.num_edges);
+      return n;
+    }
+    if (node.kind == AstNodeKind::kCompoundStatement) {
+      auto n = std::make_shared<CompoundStatement>();
+      n->statements = Children<Statement>(index, 0, node.num_edges);
+      return n;
+    }
+    if (node.kind == AstNodeKind::kExpressionStatement) {
+      auto n = std::make_shared<ExpressionStatement>();
+      n->exp = Child<Expression>(file_.Child(index, 0));
+      return n;
+    }
+    if (node.kind == AstNodeKind::kDeclarationStatement) {
+      auto n = std::make_shared<DeclarationStatement>();
+      n->decl = Child<BlockDeclaration>(file_.Child(index, 0));
+      return n;
+    }
+    if (node.kind == AstNodeKind::kAssignmentExpression) {
+      return BuildBinary<AssignmentExpression>(index);
+    }
+    if (node.kind == AstNodeKind::kEqualityExpression) {
+      return BuildBinary<EqualityExpression>(index);
+    }
+    if (node.kind == AstNodeKind::kAdditiveExpression) {
+      return BuildBinary<AdditiveExpression>(index);
+    }
+    if (node.kind == AstNodeKind::kMultiplicativeExpression) {
+      return BuildBinary<MultiplicativeExpression>(index);
+    }
+    if (node.kind == AstNodeKind::kFunctionCallExpression) {
+      auto n = std::make_shared<FunctionCallExpression>();
+      n->name = Child<Expression>(file_.Child(index, 0));
+      n->args = Children<InitializerClause>(index, 1, node.num_edges);
+      return n;
+    }
+    if (node.kind == AstNodeKind::kIntegerLiteral) {
+      auto n = std::make_shared<IntegerLiteral>();
+      n->value = node.value;
+      return n;
+    }
+    if (node.kind == AstNodeKind::kIdentifier) {
+      auto n = std::make_shared<Identifier>();
+      n->value = file_.String(node);
+      return n;
+    }
+    if (node.kind == AstNodeKind::kSimpleDeclaration) {
+      auto n = std::make_shared<SimpleDeclaration>();
+      n->specs = Children<DeclSpecifier>(index, 0, num_specs);
+      n->dtors = Children<InitDeclarator>(index, num_specs, node.num_edges);
+      return n;
+    }
+    if (node.kind == AstNodeKind::kSimpleTypeSpecifier) {
+      auto n = std::make_shared<SimpleTypeSpecifier>();
+      n->type = file_.String(node);
+      auto it = kBasicTypes.find(n->type);
+      if (it == kBasicTypes.end()) {
+        return nullptr;
+      }
+      n->type_info = &it->second;
+      return n;
+    }
+    if (node.kind == AstNodeKind::kStorageClassSpecifier) {
+      auto n = std::make_shared<StorageClassSpecifier>();
+      n->value = file_.String(node);
+      return n;
+    }
+    if (node.kind == AstNodeKind::kInitDeclarator) {
+      auto n = std::make_shared<InitDeclarator>();
+      n->dtor = Child<Declarator>(file_.Child(index, 0));
+      n->init = Child<Initializer>(file_.Child(index, 1), true);
+      return n;
+    }
+    if (node.kind == AstNodeKind::kEqualInitializer) {
+      auto n = std::make_shared<EqualInitializer>();
+      n->clause = Child<InitializerClause>(file_.Child(index, 0));
+      return n;
+    }
+    if (node.kind == AstNodeKind::kInitializerClause) {
+      auto n = std::make_shared<InitializerClause>();
+      n->assign = Child<Expression>(file_.Child(index, 0));
+      return n;
+    }
+    if (node.kind == AstNodeKind::kNoPtrDeclarator) {
+      auto n = std::make_shared<NoPtrDeclarator>();
+      n->id = Child<Identifier>(file_.Child(index, 0));
+      return n;
+    }
+    if (node.kind == AstNodeKind::kFunctionDeclarator) {
+      auto n = std::make_shared<FunctionDeclarator>();
+      n->decl = Child<NoPtrDeclarator>(file_.Child(index, 0));
+      n->param = Child<ParametersAndQualifiers>(file_.Child(index, 1));
+      return n;
+    }
+    if (node.kind == AstNodeKind::kParameterDeclaration) {
+      auto n = std::make_shared<ParameterDeclaration>();
+      n->spec = Child<DeclSpecifier>(file_.Child(index, 0));
+      n->dtor = Child<Declarator>(file_.Child(index, 1));
+      return n;
+    }
+    if (node.kind == AstNodeKind::kParametersAndQualifiers) {
+      auto n = std::make_shared<ParametersAndQualifiers>();
+      n->params = Children<ParameterDeclaration>(index, 0, node.num_edges);
+      n->omit = node.flags;
+      return n;
+    }
+    if (node.kind == AstNodeKind::kFunctionDefinition) {
+      auto n = std::make_shared<FunctionDefinition>();
+      n->specs = Children<DeclSpecifier>(index, 0, num_specs);
+      n->dtor = Child<Declarator>(file_.Child(index, num_specs));
+      n->body = Child<Statement>(file_.Child(index, num_specs + 1));
+      return n;
+    }
+    return nullptr;
+  }
+
+  const AstFile& file_;
+  bool ok_ = true;
+};
+
+} // namespace
+
+void WriteAstFile(const TranslationUnit& unit, std::ostream& out) {
+  AstWriteVisitor v;
+  const_cast<TranslationUnit&>(unit).Accept(&v, false);
+  v.Write(out);
+}
+
+AstFile::~AstFile() {
+  Close();
+}
+
+bool AstFile::Open(const std::string& path) {
+  Close();
+  if (!Map(path)) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void AstFile::Close() {
+  if (data_) {
+    munmap(data_, size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  header_ = nullptr;
+  nodes_ = nullptr;
+  edges_ = nullptr;
+  strings_ = nullptr;
+}
+
+bool AstFile::Map(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(AstFileHeader)) {
+    close(fd);
+    return false;
+  }
+  size_ = st.st_size;
+  data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data_ == MAP_FAILED) {
+    data_ = nullptr;
+    return false;
+  }
+
+  auto bytes = static_cast<const char*>(data_);
+  header_ = reinterpret_cast<const AstFileHeader*>(bytes);
+  uint64_t nodes_end = sizeof(AstFileHeader) +
+                       uint64_t{header_->num_nodes} * sizeof(AstFileNode);
+  uint64_t edges_end = nodes_end + uint64_t{header_->num_edges} * 4;
+  uint64_t strings_end = edges_end + header_->strings_size;
+  // The string table is padded to 4 bytes, so a file cut in the padding is
+  // found as well.
+  if (!std::equal(std::begin(kAstFileMagic), std::end(kAstFileMagic),
+                  header_->magic) ||
+      header_->version != kAstFileVersion || header_->num_nodes == 0 ||
+      size_ != (strings_end + 3) / 4 * 4 ||
+      (header_->strings_size > 0 && bytes[strings_end - 1] != '\0')) {
+    return false;
+  }
+  nodes_ = reinterpret_cast<const AstFileNode*>(bytes + sizeof(AstFileHeader));
+  edges_ = reinterpret_cast<const uint32_t*>(bytes + nodes_end);
+  strings_ = bytes + edges_end;
+
+  if (nodes_[0].kind != AstNodeKind::kTranslationUnit) {
+    return false;
+  }
+  // Each node but the first has one parent, so the nodes form a tree.
+  std::vector<bool> has_parent(header_->num_nodes);
+  for (uint32_t i = 0; i < header_->num_nodes; ++i) {
+    const auto& node = nodes_[i];
+    auto kind = static_cast<size_t>(node.kind);
+    if (kind >= std::size(kNumEdges) ||
+        (kNumEdges[kind] >= 0 && node.num_edges != uint32_t(kNumEdges[kind])) ||
+        uint64_t{node.first_edge} + node.num_edges > header_->num_edges ||
+        (HasString(node.kind) &&
+         uint32_t(node.value) >= header_->strings_size)) {
+      return false;
+    }
+    for (uint32_t k = 0; k < node.num_edges; ++k) {
+      auto edge = edges_[node.first_edge + k];
+      if (edge == 0) {
+        continue;
+      }
+      if (edge >= header_->num_nodes - i || has_parent[i + edge]) {
+        return false;
+      }
+      has_parent[i + edge] = true;
+    }
+  }
+  return true;
+}
+
+std::shared_ptr<TranslationUnit> BuildAst(const AstFile& file) {
+  return AstBuilder{file}.Build();
+}
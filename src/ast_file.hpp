@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+
+struct TranslationUnit;
+
+// AST files hold a translation unit in a form which tools map into memory and
+// read in place, without tokenizing, parsing or allocating per node.
+//
+// A file is an AstFileHeader, the array of nodes, the array of edges and the
+// string table, each aligned to 4 bytes, in the byte order of the host. The
+// nodes are in pre-order, so the first is the TranslationUnit and the children
+// of a node come after it. An edge is the index of a child minus the index of
+// its parent, or 0 for an absent child. Each string is stored once, with a
+// terminating null, and is referred to by its offset in the table.
+//
+// The edges of each kind of node, and what AstFileNode::value holds:
+//
+//   kTranslationUnit          decls...
+//   kCompoundStatement        statements...
+//   kExpressionStatement      exp
+//   kDeclarationStatement     decl
+//   k*Expression (binary)     lhs, rhs; op is the TokenType of the operator
+//   kFunctionCallExpression   name, args...
+//   kIntegerLiteral           value is the value
+//   kIdentifier               value is the name
+//   kSimpleDeclaration        specs..., dtors...; value is the number of specs
+//   kSimpleTypeSpecifier      value is the type name
+//   kStorageClassSpecifier    value is the specifier
+//   kInitDeclarator           dtor, init
+//   kEqualInitializer         clause
+//   kInitializerClause        assign
+//   kNoPtrDeclarator          id
+//   kFunctionDeclarator       decl, param
+//   kParameterDeclaration     spec, dtor
+//   kParametersAndQualifiers  params...; flags is omit
+//   kFunctionDefinition       specs..., dtor, body; value is the number of specs
+//
+// The token ranges of declarations are not kept, nor braced initializer lists,
+// which the parser does not produce.
+
+enum class AstNodeKind : uint8_t {
+  kTranslationUnit,
+  kCompoundStatement,
+  kExpressionStatement,
+  kDeclarationStatement,
+  kAssignmentExpression,
+  kEqualityExpression,
+  kAdditiveExpression,
+  kMultiplicativeExpression,
+  kFunctionCallExpression,
+  kIntegerLiteral,
+  kIdentifier,
+  kSimpleDeclaration,
+  kSimpleTypeSpecifier,
+  kStorageClassSpecifier,
+  kInitDeclarator,
+  kEqualInitializer,
+  kInitializerClause,
+  kNoPtrDeclarator,
+  kFunctionDeclarator,
+  kParameterDeclaration,
+  kParametersAndQualifiers,
+  kFunctionDefinition,
+};
+
+struct AstFileHeader {
+  char magic[8]; // kAstFileMagic
+  uint32_t version;
+  uint32_t num_nodes;
+  uint32_t num_edges;
+  uint32_t strings_size; // bytes
+};
+
+struct AstFileNode {
+  AstNodeKind kind;
+  uint8_t op;
+  uint16_t flags;
+  int32_t value; // an integer, a string offset or a count, by kind
+  uint32_t first_edge;
+  uint32_t num_edges;
+};
+
+const char kAstFileMagic[8] = {'9', 'c', 'x', 'x', 'A', 'S', 'T', '\0'};
+const uint32_t kAstFileVersion = 1;
+
+// Writes unit to out in the format above.
+void WriteAstFile(const TranslationUnit& unit, std::ostream& out);
+
+// An AST file mapped into memory. Open() checks the whole file, so that the
+// accessors may trust the indices and offsets in it.
+class AstFile {
+ public:
+  static const uint32_t kNoNode = UINT32_MAX;
+
+  AstFile() = default;
+  AstFile(const AstFile&) = delete;
+  AstFile& operator=(const AstFile&) = delete;
+  ~AstFile();
+
+  // Maps the file at path, in place of any file opened before. Returns false,
+  // leaving no file open, if it cannot be read or is not a valid AST file.
+  bool Open(const std::string& path);
+
+  uint32_t NumNodes() const {
+    return header_->num_nodes;
+  }
+
+  const AstFileNode& Node(uint32_t index) const {
+    return nodes_[index];
+  }
+
+  // Returns the index of the k-th child of the index-th node, or kNoNode if
+  // the child is absent.
+  uint32_t Child(uint32_t index, uint32_t k) const {
+    auto edge = edges_[nodes_[index].first_edge + k];
+    return edge == 0 ? kNoNode : index + edge;
+  }
+
+  // Returns the string which the value of a node refers to.
+  std::string_view String(const AstFileNode& node) const {
+    return strings_ + node.value;
+  }
+
+ private:
+  // Maps and checks the file for Open(), which closes it on failure.
+  bool Map(const std::string& path);
+  // Unmaps the file and resets the members.
+  void Close();
+
+  void* data_ = nullptr;
+  size_t size_ = 0;
+  const AstFileHeader* header_ = nullptr;
+  const AstFileNode* nodes_ = nullptr;
+  const uint32_t* edges_ = nullptr;
+  const char* strings_ = nullptr;
+};
+
+// Builds the AST held in file, for passes which work on the AST itself.
+std::shared_ptr<TranslationUnit> BuildAst(const AstFile& file);
@@ -0,0 +1,258 @@
+#include "cache.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <sstream>
+#include <utility>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include "hash.hpp"
+
+namespace {
+
+const char kStatsFile[] = "stats";
+const char kEntrySuffix[] = ".s";
+
+bool IsEntry(const std::string& name) {
+  const size_t len = sizeof(kEntrySuffix) - 1;
+  return name.size() > len &&
+         name.compare(name.size() - len, len, kEntrySuffix) == 0;
+}
+
+// The contents of the stats file. bytes is the total size of the entries, or
+// unknown in a file written before it was kept.
+struct StatsCounts {
+  uint64_t hits = 0, misses = 0, bytes = 0;
+  bool has_bytes = false;
+};
+
+// Reads the stats file at path, lets update change the counts and writes them
+// back, all under an exclusive lock of the file.
+void UpdateStats(const std::string& path,
+                 const std::function<void(StatsCounts&)>& update) {
+  int fd = open(path.c_str(), O_RDWR | O_CREAT, 0666);
+  if (fd < 0) {
+    return;
+  }
+  flock(fd, LOCK_EX);
+  char buf[96] = {};
+  StatsCounts counts;
+  if (read(fd, buf, sizeof(buf) - 1) > 0) {
+    counts.has_bytes =
+        sscanf(buf, "hits %" SCNu64 " misses %" SCNu64 " bytes %" SCNu64,
+               &counts.hits, &counts.misses, &counts.bytes) == 3;
+  }
+  update(counts);
+  int len = snprintf(buf, sizeof(buf),
+                     "hits %" PRIu64 " misses %" PRIu64 " bytes %" PRIu64 "\n",
+                     counts.hits, counts.misses, counts.bytes);
+  pwrite(fd, buf, len, 0);
+  ftruncate(fd, len);
+  flock(fd, LOCK_UN);
+  close(fd);
+}
+
+} // namespace
+
+CompileCache::CompileCache(const std::string& dir, uint64_t max_bytes)
+    : dir_{dir}, max_bytes_{max_bytes} {
+  mkdir(dir_.c_str(), 0777);
+}
+
+std::string CompileCache::Key(const std::string& src,
+                              const CompileOptions& options) {
+  Hasher hasher;
+  hasher.Add(CompileOptionsKey(options));
+  hasher.Add(src.data(), src.size());
+  return hasher.HexDigest();
+}
+
+bool CompileCache::Load(const std::string& key, std::string& code) {
+  auto path = EntryPath(key);
+  std::ifstream in{path, std::ios::binary};
+  bool hit = static_cast<bool>(in);
+  if (hit) {
+    code.assign(std::istreambuf_iterator<char>{in}, {});
+    utime(path.c_str(), nullptr);
+  }
+  CountLookup(hit);
+  return hit;
+}
+
+void CompileCache::Store(const std::string& key, const std::string& code) {
+  // Concurrent writers of the same entry each rename a complete file into
+  // place, so a reader never sees a partial entry.
+  auto tmp_path = dir_ + "/tmp.XXXXXX";
+  int fd = mkstemp(&tmp_path[0]);
+  if (fd < 0) {
+    return;
+  }
+  bool written = write(fd, code.data(), code.size()) ==
+                 static_cast<ssize_t>(code.size());
+  close(fd);
+  auto path = EntryPath(key);
+  struct stat st;
+  uint64_t replaced_size = stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+  if (!written || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+    return;
+  }
+
+  // The directory is only scanned when the running total exceeds the limit,
+  // or is not known yet.
+  UpdateStats(dir_ + '/' + kStatsFile, [&](StatsCounts& counts) {
+    counts.bytes += code.size();
+    counts.bytes -= std::min(counts.bytes, replaced_size);
+    if (!counts.has_bytes || counts.bytes > max_bytes_) {
+      counts.bytes = Evict();
+    }
+  });
+}
+
+CompileCache::Stats CompileCache::GetStats() const {
+  Stats stats{};
+  std::ifstream in{dir_ + '/' + kStatsFile};
+  std::string name;
+  in >> name >> stats.hits >> name >> stats.misses;
+
+  if (auto d = opendir(dir_.c_str())) {
+    while (auto ent = readdir(d)) {
+      struct stat st;
+      if (IsEntry(ent->d_name) &&
+          stat((dir_ + '/' + ent->d_name).c_str(), &st) == 0) {
+        ++stats.entries;
+        stats.bytes += st.st_size;
+      }
+    }
+    closedir(d);
+  }
+  return stats;
+}
+
+std::string CompileCache::EntryPath(const std::string& key) const {
+  return dir_ + '/' + key + kEntrySuffix;
+}
+
+void CompileCache::CountLookup(bool hit) {
+  UpdateStats(dir_ + '/' + kStatsFile, [hit](StatsCounts& counts) {
+    ++(hit ? counts.hits : counts.misses);
+  });
+}
+
+uint64_t CompileCache::Evict() {
+  std::vector<std::pair<time_t, std::string>> entries;
+  uint64_t total_bytes = 0;
+  if (auto d = opendir(dir_.c_str())) {
+    while (auto ent = readdir(d)) {
+      auto path = dir_ + '/' + ent->d_name;
+      struct stat st;
+      if (IsEntry(ent->d_name) && stat(path.c_str(), &st) == 0) {
+        entries.emplace_back(st.st_mtime, path);
+        total_bytes += st.st_size;
+      }
+    }
+    closedir(d);
+  }
+  if (total_bytes <= max_bytes_) {
+    return total_bytes;
+  }
+
+  std::sort(entries.begin(), entries.end());
+  for (const auto& [mtime, path] : entries) {
+    if (total_bytes <= max_bytes_) {
+      break;
+    }
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && unlink(path.c_str()) == 0) {
+      total_bytes -= st.st_size;
+    }
+  }
+  return total_bytes;
+}
+
+// The sidecar file is a sequence of entries, each a line with the key and the
+// size of the code, followed by the code.
+void FunctionCache::Load(const std::string& path) {
+  loaded_.clear();
+  std::ifstream in{path, std::ios::binary};
+  std::string key;
+  size_t size;
+  while (in >> key >> size && in.ignore()) {
+    std::string code(size, '\0');
+    if (!in.read(&code[0], size)) {
+      loaded_.clear();
+      return;
+    }
+    loaded_[key] = std::move(code);
+  }
+}
+
+bool FunctionCache::Save(const std::string& path) const {
+  if (used_.empty()) {
+    // Nothing was looked up, as on a hit of the whole translation unit.
+    return true;
+  }
+  auto tmp_path = path + ".XXXXXX";
+  int fd = mkstemp(&tmp_path[0]);
+  if (fd < 0) {
+    return false;
+  }
+  close(fd);
+
+  std::ofstream out{tmp_path, std::ios::binary};
+  for (const auto& [key, code] : used_) {
+    out << key << ' ' << code.size() << '\n' << code;
+  }
+  out.close();
+  if (!out || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool FunctionCache::Find(const std::string& key, std::string& code) {
+  auto it = loaded_.find(key);
+  if (it == loaded_.end()) {
+    return false;
+  }
+  code = it->second;
+  used_[key] = it->second;
+  ++hits_;
+  return true;
+}
+
+void FunctionCache::Add(const std::string& key, const std::string& code) {
+  used_[key] = code;
+}
+
+int CompileCached(CompileCache& cache, const std::string& src,
+                  std::ostream& out, std::ostream& err,
+                  const CompileOptions& options, FunctionCache* fn_cache,
+                  CompileStats* stats) {
+  auto key = CompileCache::Key(src, options);
+  std::string code;
+  if (cache.Load(key, code)) {
+    out << code;
+    return 0;
+  }
+
+  std::ostringstream code_out;
+  int result = Compile(src, code_out, err, options, fn_cache, stats);
+  if (result == 0) {
+    code = code_out.str();
+    cache.Store(key, code);
+    out << code;
+  }
+  return result;
+}
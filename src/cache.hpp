@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "compiler.hpp"
+
+// An on-disk cache of compiled assembly, keyed by a hash of the source and
+// CompileOptionsKey(). Several processes may share a cache directory.
+//
+// Each entry is a file <dir>/<sha1>.s, written to a temporary file and renamed
+// into place. A hit updates the file's mtime. Hit and miss counts and the total
+// size of the entries are kept in <dir>/stats, and when Store() takes the total
+// over max_bytes, it removes the entries with the oldest mtime until it fits.
+class CompileCache {
+ public:
+  struct Stats {
+    uint64_t hits, misses, entries, bytes;
+  };
+
+  CompileCache(const std::string& dir, uint64_t max_bytes);
+
+  static std::string Key(const std::string& src, const CompileOptions& options);
+
+  // Reads the entry for key into code. Returns false on a miss.
+  bool Load(const std::string& key, std::string& code);
+  void Store(const std::string& key, const std::string& code);
+
+  Stats GetStats() const;
+
+ private:
+  std::string EntryPath(const std::string& key) const;
+  void CountLookup(bool hit);
+  // Removes the oldest entries while their total size exceeds max_bytes_.
+  // Returns the total size of the entries left.
+  uint64_t Evict();
+
+  std::string dir_;
+  uint64_t max_bytes_;
+};
+
+// The code generated for each function definition, kept in a sidecar file next
+// to the output so that a recompile only regenerates the changed functions.
+// Keys are computed by the code generator.
+class FunctionCache {
+ public:
+  // Reads the entries saved at path. A missing or broken file gives an empty
+  // cache.
+  void Load(const std::string& path);
+
+  // Writes the entries found or added since Load() to path, dropping those of
+  // functions which no longer exist.
+  bool Save(const std::string& path) const;
+
+  // Entries are assembly text of whole lines.
+  bool Find(const std::string& key, std::string& code);
+  void Add(const std::string& key, const std::string& code);
+
+  size_t Hits() const { return hits_; }
+
+ private:
+  std::map<std::string, std::string> loaded_, used_;
+  size_t hits_ = 0;
+};
+
+// Same as Compile(), but returns the assembly from cache without tokenizing
+// if it has been compiled before. A successful result is stored in cache. On a
+// hit no phase runs, so stats is left as it is.
+int CompileCached(CompileCache& cache, const std::string& src,
+                  std::ostream& out, std::ostream& err,
+                  const CompileOptions& options,
+                  FunctionCache* fn_cache = nullptr,
+                  CompileStats* stats = nullptr);
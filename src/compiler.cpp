@@ -0,0 +1,3251 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <cctype>
+#include <string>
+#include <vector>
+#include <map>
+#include <optional>
+#include <set>
+#include <array>
+#include <algorithm>
+#include <tuple>
+#include <utility>
+#include <functional>
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <sys/resource.h>
+
+#include "compiler.hpp"
+#include "ast_file.hpp"
+#include "cache.hpp"
+#include "hash.hpp"
+#include "tokenizer.hpp"
+#include "parser.hpp"
+#include "ast.hpp"
+#include "thread_pool.hpp"
+
+// A symbol as written in assembly: the identifier, with a leading underscore
+// if the object format needs one.
+struct Symbol {
+  std::string_view id_name;
+  bool leading_underscore;
+};
+
+// A variable in the stack frame, [rbp - rbp_offset].
+struct FrameOperand {
+  long rbp_offset;
+};
+
+// A symbol addressed relative to rip, [rel symbol + offset], or its entry in
+// the global offset table if got.
+struct RelOperand {
+  Symbol symbol;
+  bool got = false;
+  long offset = 0;
+};
+
+// Assembly text of a part of the translation unit. Lines are formatted
+// straight into one buffer, with no intermediate strings.
+class CodeBuffer {
+ public:
+  // Appends a line made of the pieces in args: strings, integers, symbols and
+  // memory operands.
+  template <typename... Args>
+  void Line(const Args&... args) {
+    (Put(args), ...);
+    text_ += '\n';
+    ++num_lines_;
+  }
+
+  // Appends text consisting of whole lines.
+  void Append(std::string_view text) {
+    text_.append(text.data(), text.size());
+    num_lines_ += std::count(text.begin(), text.end(), '\n');
+  }
+
+  const std::string& Text() const {
+    return text_;
+  }
+
+  size_t NumLines() const {
+    return num_lines_;
+  }
+
+ private:
+  void Put(std::string_view s) {
+    text_.append(s.data(), s.size());
+  }
+
+  void Put(long value) {
+    char buf[24];
+    auto result = std::to_chars(buf, buf + sizeof(buf), value);
+    text_.append(buf, result.ptr);
+  }
+
+  void Put(const Symbol& symbol) {
+    if (symbol.leading_underscore) {
+      text_ += '_';
+    }
+    Put(symbol.id_name);
+  }
+
+  void Put(const FrameOperand& operand) {
+    if (operand.rbp_offset < 0) {
+      Put("[rbp + ");
+      Put(-operand.rbp_offset);
+    } else {
+      Put("[rbp - ");
+      Put(operand.rbp_offset);
+    }
+    text_ += ']';
+  }
+
+  void Put(const RelOperand& operand) {
+    Put("[rel ");
+    Put(operand.symbol);
+    if (operand.offset != 0) {
+      Put(" + ");
+      Put(operand.offset);
+    }
+    if (operand.got) {
+      Put(" wrt ..gotpcrel");
+    }
+    text_ += ']';
+  }
+
+  std::string text_;
+  size_t num_lines_ = 0;
+};
+
+enum class IdType {
+  kUnknown,
+  kLocalVariable,
+  kGlobal,         // a function
+  kGlobalVariable, // a variable at namespace scope
+};
+
+struct IdInfo {
+  IdType type;
+  long rbp_offset; // [rbp - rbp_offset]
+  const TypeInfo* type_info;
+  int reg; // index of kParamRegList if the variable lives in a register, or -1
+};
+
+const std::array<std::string, 6> kParamRegList{
+  "rdi",
+  "rsi",
+  "rdx",
+  "rcx",
+  "r8",
+  "r9",
+};
+
+const std::array<std::string, 6> kParamReg32List{
+  "edi",
+  "esi",
+  "edx",
+  "ecx",
+  "r8d",
+  "r9d",
+};
+
+const std::array<std::string, 6> kParamReg8List{
+  "dil",
+  "sil",
+  "dl",
+  "cl",
+  "r8b",
+  "r9b",
+};
+
+const size_t kRdxParamIndex = 2;
+
+Symbol ExternName(const std::string& id_name, const CompileOptions& options) {
+  return {id_name, options.leading_underscore};
+}
+
+bool IsElf(const CompileOptions& options) {
+  return options.object_format == ObjectFormat::kElf64;
+}
+
+class BaseVisitor : public Visitor {
+ public:
+  void Visit(TranslationUnit* unit, bool lvalue) {
+    for (const auto& decl : unit->decls) {
+      decl->Accept(this, lvalue);
+    }
+  }
+  void Visit(CompoundStatement* stmt, bool lvalue) {}
+  void Visit(ExpressionStatement* stmt, bool lvalue) {}
+  void Visit(DeclarationStatement* stmt, bool lvalue) {}
+  void Visit(AssignmentExpression* exp, bool lvalue) {}
+  void Visit(EqualityExpression* exp, bool lvalue) {}
+  void Visit(AdditiveExpression* exp, bool lvalue) {}
+  void Visit(MultiplicativeExpression* exp, bool lvalue) {}
+  void Visit(FunctionCallExpression* exp, bool lvalue) {}
+  void Visit(IntegerLiteral* exp, bool lvalue) {}
+  void Visit(Identifier* exp, bool lvalue) {}
+  void Visit(SimpleDeclaration* decl, bool lvalue) {}
+  void Visit(SimpleTypeSpecifier* spec, bool lvalue) {}
+  void Visit(StorageClassSpecifier* spec, bool lvalue) {}
+  void Visit(InitDeclarator* dtor, bool lvalue) {
+    dtor->dtor->Accept(this, lvalue);
+    if (dtor->init) dtor->init->Accept(this, lvalue);
+  }
+  void Visit(EqualInitializer* init, bool lvalue) {
+    init->clause->Accept(this, lvalue);
+  }
+  void Visit(InitializerClause* clause, bool lvalue) {
+    if (clause->assign) clause->assign->Accept(this, lvalue);
+    if (clause->braced) clause->braced->Accept(this, lvalue);
+  }
+  void Visit(NoPtrDeclarator* dtor, bool lvalue) {
+    dtor->id->Accept(this, lvalue);
+  }
+  void Visit(FunctionDeclarator* dtor, bool lvalue) {
+    dtor->decl->Accept(this, lvalue);
+    dtor->param->Accept(this, lvalue);
+  }
+  void Visit(ParameterDeclaration* decl, bool lvalue) {
+    decl->spec->Accept(this, lvalue);
+    decl->dtor->Accept(this, lvalue);
+  }
+  void Visit(ParametersAndQualifiers* pq, bool lvalue) {
+    for (const auto& decl : pq->params) {
+      decl->Accept(this, lvalue);
+    }
+  }
+  void Visit(FunctionDefinition* defn, bool lvalue) {
+    for (const auto& spec : defn->specs) {
+      spec->Accept(this, lvalue);
+    }
+    defn->dtor->Accept(this, lvalue);
+    defn->body->Accept(this, lvalue);
+  }
+};
+
+class DeclSpecifierVisitor : public BaseVisitor {
+ public:
+  void Visit(SimpleTypeSpecifier* spec, bool lvalue) {
+    BaseVisitor::Visit(spec, lvalue);
+    simple_type_specifier_ = spec;
+  }
+
+  void Visit(StorageClassSpecifier* spec, bool lvalue) {
+    is_static_ = is_static_ || spec->value == "static";
+  }
+
+  SimpleTypeSpecifier* SimpleTypeSpecifier() {
+    return simple_type_specifier_;
+  }
+
+  bool IsStatic() const {
+    return is_static_;
+  }
+
+ private:
+  struct SimpleTypeSpecifier* simple_type_specifier_ = nullptr;
+  bool is_static_ = false;
+};
+
+class InitDeclaratorVisitor : public BaseVisitor {
+ public:
+  void Visit(InitializerClause* clause, bool lvalue) {
+    // The identifiers in the initializer are not the declarator's.
+    initializer_clause_= clause;
+  }
+
+  void Visit(Identifier* id, bool lvalue) {
+    BaseVisitor::Visit(id, lvalue);
+    id_ = id;
+  }
+
+  void Visit(FunctionDeclarator* dtor, bool lvalue) {
+    // The identifiers of the parameters are not the declarator's.
+    dtor->decl->Accept(this, lvalue);
+    function_declarator_ = dtor;
+  }
+
+  InitializerClause* InitializerClause() {
+    return initializer_clause_;
+  }
+
+  Identifier* Identifier() {
+    return id_;
+  }
+
+  FunctionDeclarator* FunctionDeclarator() {
+    return function_declarator_;
+  }
+
+ private:
+  struct InitializerClause* initializer_clause_ = nullptr;
+  struct Identifier* id_ = nullptr;
+  struct FunctionDeclarator* function_declarator_ = nullptr;
+};
+
+size_t AlignUp(size_t value, size_t align) {
+  return (value + align - 1) / align * align;
+}
+
+// Returns the identifier of the variable which an assignment to exp stores to:
+// exp itself, or the left side of exp if it is an assignment, which yields its
+// variable. Returns null if exp names no variable.
+Identifier* AssignedIdentifier(Expression* exp) {
+  while (auto n = dynamic_cast<AssignmentExpression*>(exp)) {
+    exp = n->lhs.get();
+  }
+  return dynamic_cast<Identifier*>(exp);
+}
+
+// Visits every statement and expression of a function body.
+class FunctionBodyVisitor : public BaseVisitor {
+ public:
+  void Visit(CompoundStatement* stmt, bool lvalue) {
+    for (auto& n : stmt->statements) {
+      n->Accept(this, lvalue);
+    }
+  }
+
+  void Visit(ExpressionStatement* stmt, bool lvalue) {
+    stmt->exp->Accept(this, lvalue);
+  }
+
+  void Visit(DeclarationStatement* stmt, bool lvalue) {
+    stmt->decl->Accept(this, lvalue);
+  }
+
+  void Visit(AssignmentExpression* exp, bool lvalue) {
+    exp->lhs->Accept(this, lvalue);
+    exp->rhs->Accept(this, lvalue);
+  }
+
+  void Visit(EqualityExpression* exp, bool lvalue) {
+    exp->lhs->Accept(this, lvalue);
+    exp->rhs->Accept(this, lvalue);
+  }
+
+  void Visit(AdditiveExpression* exp, bool lvalue) {
+    exp->lhs->Accept(this, lvalue);
+    exp->rhs->Accept(this, lvalue);
+  }
+
+  void Visit(MultiplicativeExpression* exp, bool lvalue) {
+    exp->lhs->Accept(this, lvalue);
+    exp->rhs->Accept(this, lvalue);
+  }
+
+  void Visit(FunctionCallExpression* exp, bool lvalue) {
+    exp->name->Accept(this, lvalue);
+    for (const auto& arg : exp->args) {
+      arg->Accept(this, lvalue);
+    }
+  }
+
+  // Visits the initializers of the declared variables.
+  void Visit(SimpleDeclaration* decl, bool lvalue) {
+    for (const auto& init_decl : decl->dtors) {
+      InitDeclaratorVisitor v;
+      init_decl->Accept(&v, false);
+      if (auto clause = v.InitializerClause()) {
+        clause->assign->Accept(this, false);
+      }
+    }
+  }
+};
+
+// Collects local variables of a function body, computes their live ranges and
+// assigns stack slots to them.
+//
+// Function bodies are straight-line code, so a variable is live from its
+// declaration to its last use. Variables whose live ranges do not overlap share
+// a stack slot, which makes the frame size the maximum amount of live data
+// rather than the sum of all declarations.
+class FrameLayoutVisitor : public FunctionBodyVisitor {
+ public:
+  FrameLayoutVisitor() : scopes_(1) {
+  }
+
+  void Visit(CompoundStatement* stmt, bool lvalue) {
+    scopes_.emplace_back();
+    FunctionBodyVisitor::Visit(stmt, lvalue);
+    scopes_.pop_back();
+  }
+
+  void Visit(ExpressionStatement* stmt, bool lvalue) {
+    ++point_;
+    FunctionBodyVisitor::Visit(stmt, lvalue);
+  }
+
+  void Visit(DeclarationStatement* stmt, bool lvalue) {
+    ++point_;
+    FunctionBodyVisitor::Visit(stmt, lvalue);
+  }
+
+  void Visit(Identifier* exp, bool lvalue) {
+    for (auto it = scopes_.rbegin(); it != scopes_.rend(); ++it) {
+      auto found = it->find(exp->value);
+      if (found == it->end()) {
+        continue;
+      }
+      if (found->second != kNotLocal) {
+        locals_[found->second].last_use = point_;
+        uses_[exp] = found->second;
+      }
+      return;
+    }
+  }
+
+  void Visit(SimpleDeclaration* decl, bool lvalue) {
+    DeclSpecifierVisitor v;
+    for (const auto& spec : decl->specs) {
+      spec->Accept(&v, false);
+    }
+
+    for (const auto& init_decl : decl->dtors) {
+      InitDeclaratorVisitor v2;
+      init_decl->Accept(&v2, false);
+      const auto& id_name = v2.Identifier()->value;
+      if (v2.FunctionDeclarator()) {
+        scopes_.back()[id_name] = kNotLocal;
+      } else {
+        scopes_.back()[id_name] = locals_.size();
+        uses_[v2.Identifier()] = locals_.size();
+        locals_.push_back(
+            {v.SimpleTypeSpecifier()->type_info, point_, point_, 0, 0, -1});
+      }
+      // The variable is in scope in its own initializer.
+      if (auto clause = v2.InitializerClause()) {
+        clause->assign->Accept(this, false);
+      }
+    }
+  }
+
+  // Declares the index-th parameter of the function. Must be called before
+  // visiting the function body. The first six parameters arrive in registers;
+  // those which are not kept there are spilled to stack slots. The others are
+  // in the caller's frame.
+  void DeclareParameter(const Identifier* id, const TypeInfo* type_info,
+                        size_t index, bool keep_in_register) {
+    Local local{type_info, 0, 0, 0, 0, -1};
+    if (index >= kParamRegList.size()) {
+      local.slot = kNoSlot;
+      local.rbp_offset = -static_cast<long>(16 + 8 * (index - kParamRegList.size()));
+    } else if (keep_in_register) {
+      local.slot = kNoSlot;
+      local.reg = index;
+    }
+    scopes_.back()[id->value] = locals_.size();
+    uses_[id] = locals_.size();
+    locals_.push_back(local);
+  }
+
+  // Adds an unnamed int variable live from first_point to last_use, and
+  // returns its index.
+  size_t AddTemporary(size_t first_point, size_t last_use) {
+    locals_.push_back({&kBasicTypes.at("int"), first_point, last_use, 0, 0, -1});
+    return locals_.size() - 1;
+  }
+
+  // Assigns a stack slot to each local variable and returns the frame size.
+  // Every identifier which refers to a local variable is mapped to its IdInfo.
+  size_t Layout(std::map<const Identifier*, IdInfo>& locals) {
+    // Each local, in order of the start of its live range, takes the smallest
+    // free slot which is large enough, or a new slot if there is none.
+    std::vector<Local*> sorted_locals;
+    for (auto& local : locals_) {
+      if (local.slot != kNoSlot) {
+        sorted_locals.push_back(&local);
+      }
+    }
+    std::stable_sort(sorted_locals.begin(), sorted_locals.end(),
+        [](const Local* a, const Local* b) {
+          return a->decl_point < b->decl_point;
+        });
+
+    std::vector<Slot> slots;
+    for (auto local : sorted_locals) {
+      size_t best = slots.size();
+      for (size_t i = 0; i < slots.size(); ++i) {
+        if (slots[i].last_use < local->decl_point &&
+            slots[i].size >= local->type_info->size &&
+            slots[i].align >= local->type_info->align &&
+            (best == slots.size() || slots[i].size < slots[best].size)) {
+          best = i;
+        }
+      }
+      if (best == slots.size()) {
+        slots.push_back({local->type_info->size, local->type_info->align, 0, 0});
+      }
+      slots[best].last_use = local->last_use;
+      local->slot = best;
+    }
+
+    // Slots are packed in descending order of alignment so that no padding is
+    // needed between them.
+    std::vector<Slot*> sorted_slots;
+    for (auto& slot : slots) {
+      sorted_slots.push_back(&slot);
+    }
+    std::stable_sort(sorted_slots.begin(), sorted_slots.end(),
+        [](const Slot* a, const Slot* b) { return a->align > b->align; });
+
+    size_t rbp_offset = 0;
+    for (auto slot : sorted_slots) {
+      rbp_offset = AlignUp(rbp_offset + slot->size, slot->align);
+      slot->rbp_offset = rbp_offset;
+    }
+
+    for (auto& local : locals_) {
+      if (local.slot != kNoSlot) {
+        local.rbp_offset = slots[local.slot].rbp_offset;
+      }
+    }
+    for (const auto& [id, local_index] : uses_) {
+      const auto& local = locals_[local_index];
+      locals[id] = {IdType::kLocalVariable, local.rbp_offset, local.type_info,
+                    local.reg};
+    }
+    return AlignUp(rbp_offset, 16);
+  }
+
+  // Valid after Layout().
+  long RbpOffset(size_t local_index) const {
+    return locals_[local_index].rbp_offset;
+  }
+
+  // Maps identifiers referring to local variables to the index of the variable.
+  const std::map<const Identifier*, size_t>& Uses() const {
+    return uses_;
+  }
+
+ private:
+  static const size_t kNotLocal = static_cast<size_t>(-1);
+  static const size_t kNoSlot = static_cast<size_t>(-1);
+
+  struct Local {
+    const TypeInfo* type_info;
+    size_t decl_point, last_use;
+    size_t slot; // kNoSlot if the variable does not need a stack slot
+    long rbp_offset;
+    int reg;
+  };
+
+  struct Slot {
+    size_t size, align;
+    size_t last_use;
+    long rbp_offset;
+  };
+
+  std::vector<std::map<std::string, size_t>> scopes_;
+  std::vector<Local> locals_;
+  std::map<const Identifier*, size_t> uses_;
+  size_t point_ = 0;
+};
+
+// Collects the names of the functions called from a function body or an
+// expression, and of the other identifiers used in it. Also records whether it
+// multiplies or divides, which clobbers rdx, and which variables it takes the
+// address of.
+class CalleeVisitor : public FunctionBodyVisitor {
+ public:
+  void Visit(Identifier* exp, bool lvalue) {
+    names_.insert(exp->value);
+  }
+
+  void Visit(AssignmentExpression* exp, bool lvalue) {
+    // An assignment to an assignment stores through the address of the
+    // variable of the inner one.
+    if (!dynamic_cast<Identifier*>(exp->lhs.get())) {
+      if (auto id = AssignedIdentifier(exp->lhs.get())) {
+        addressed_.insert(id->value);
+      }
+    }
+    FunctionBodyVisitor::Visit(exp, lvalue);
+  }
+
+  void Visit(MultiplicativeExpression* exp, bool lvalue) {
+    multiplies_ = true;
+    FunctionBodyVisitor::Visit(exp, lvalue);
+  }
+
+  void Visit(FunctionCallExpression* exp, bool lvalue) {
+    if (auto n = std::dynamic_pointer_cast<Identifier>(exp->name)) {
+      callees_.insert(n->value);
+    } else {
+      indirect_call_ = true;
+    }
+    for (const auto& arg : exp->args) {
+      arg->Accept(this, lvalue);
+    }
+  }
+
+  const std::set<std::string>& Callees() const {
+    return callees_;
+  }
+
+  // Identifiers used other than as the name of a called function.
+  const std::set<std::string>& Names() const {
+    return names_;
+  }
+
+  bool IndirectCall() const {
+    return indirect_call_;
+  }
+
+  bool Calls() const {
+    return indirect_call_ || !callees_.empty();
+  }
+
+  bool Multiplies() const {
+    return multiplies_;
+  }
+
+  // Names of the variables whose address is taken.
+  const std::set<std::string>& Addressed() const {
+    return addressed_;
+  }
+
+ private:
+  std::set<std::string> callees_;
+  std::set<std::string> names_;
+  std::set<std::string> addressed_;
+  bool indirect_call_ = false;
+  bool multiplies_ = false;
+};
+
+// Returns the order in which the arguments of a call are evaluated.
+//
+// Arguments passed on the stack are pushed first, from the last one. The
+// register arguments which contain calls are evaluated next and pushed, since
+// a call clobbers the argument registers. The other register arguments are
+// evaluated directly into their registers; the one passed in rdx comes last
+// because multiplication and division clobber rdx. Finally the pushed register
+// arguments are popped into their registers.
+std::vector<size_t> ArgumentEvaluationOrder(const FunctionCallExpression* exp) {
+  std::vector<size_t> order;
+  for (size_t i = exp->args.size(); i > kParamRegList.size(); --i) {
+    order.push_back(i - 1);
+  }
+
+  size_t num_reg_args = std::min(exp->args.size(), kParamRegList.size());
+  for (size_t i = num_reg_args; i > 0; --i) {
+    CalleeVisitor v;
+    exp->args[i - 1]->Accept(&v, false);
+    if (v.Calls()) {
+      order.push_back(i - 1);
+    }
+  }
+  for (size_t i = 0; i < num_reg_args; ++i) {
+    CalleeVisitor v;
+    exp->args[i]->Accept(&v, false);
+    if (!v.Calls() && i != kRdxParamIndex) {
+      order.push_back(i);
+    }
+  }
+  if (num_reg_args > kRdxParamIndex) {
+    CalleeVisitor v;
+    exp->args[kRdxParamIndex]->Accept(&v, false);
+    if (!v.Calls()) {
+      order.push_back(kRdxParamIndex);
+    }
+  }
+  return order;
+}
+
+// Returns the names of the functions defined in unit which have no side
+// effects. Such a function only computes with its parameters and locals, and
+// only calls functions which have no side effects. A function which uses a name
+// in global_variables is not pure, even if the name refers to a local.
+std::set<std::string> FindPureFunctions(
+    TranslationUnit* unit, const std::set<std::string>& global_variables) {
+  std::map<std::string, CalleeVisitor> callees;
+  for (const auto& decl : unit->decls) {
+    auto defn = std::dynamic_pointer_cast<FunctionDefinition>(decl);
+    if (!defn) {
+      continue;
+    }
+    InitDeclaratorVisitor v;
+    defn->dtor->Accept(&v, false);
+    if (v.Identifier()) {
+      defn->body->Accept(&callees[v.Identifier()->value], false);
+    }
+  }
+
+  std::set<std::string> pure_functions;
+  for (const auto& [name, v] : callees) {
+    const auto& names = v.Names();
+    bool uses_global = std::any_of(names.begin(), names.end(),
+        [&](const std::string& used) { return global_variables.count(used); });
+    if (!v.IndirectCall() && !uses_global) {
+      pure_functions.insert(name);
+    }
+  }
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (auto it = pure_functions.begin(); it != pure_functions.end(); ) {
+      const auto& callee_names = callees[*it].Callees();
+      bool pure = std::all_of(callee_names.begin(), callee_names.end(),
+          [&](const std::string& name) { return pure_functions.count(name); });
+      if (pure) {
+        ++it;
+      } else {
+        it = pure_functions.erase(it);
+        changed = true;
+      }
+    }
+  }
+  return pure_functions;
+}
+
+// Numbers the values computed in a function body (local value numbering).
+// Pure expressions which compute the same value get the same number.
+//
+// Expressions are visited in the order CodeGenerateVisitor evaluates them. A
+// function body is a single basic block, so the numbering spans the whole
+// function. Calls to impure functions are barriers: values computed before
+// them are not reused after them.
+class ValueNumberingVisitor : public BaseVisitor {
+ public:
+  ValueNumberingVisitor(const std::map<const Identifier*, size_t>& local_uses,
+                        const std::set<std::string>& pure_functions)
+      : local_uses_{local_uses}, pure_functions_{pure_functions} {
+  }
+
+  void Visit(CompoundStatement* stmt, bool lvalue) {
+    for (auto& n : stmt->statements) {
+      n->Accept(this, lvalue);
+    }
+  }
+
+  void Visit(ExpressionStatement* stmt, bool lvalue) {
+    stmt->exp->Accept(this, false);
+  }
+
+  void Visit(DeclarationStatement* stmt, bool lvalue) {
+    stmt->decl->Accept(this, lvalue);
+  }
+
+  void Visit(SimpleDeclaration* decl, bool lvalue) {
+    for (const auto& init_decl : decl->dtors) {
+      InitDeclaratorVisitor v;
+      init_decl->Accept(&v, false);
+      if (auto clause = v.InitializerClause()) {
+        clause->Accept(this, false);
+      }
+      if (auto it = local_uses_.find(v.Identifier()); it != local_uses_.end()) {
+        variables_[it->second] = NewValue();
+      }
+    }
+  }
+
+  void Visit(AssignmentExpression* exp, bool lvalue) {
+    exp->rhs->Accept(this, false);
+    // A left side other than an identifier is an assignment, which is
+    // evaluated after the right side and stores to the same variable.
+    if (!std::dynamic_pointer_cast<Identifier>(exp->lhs)) {
+      exp->lhs->Accept(this, true);
+    }
+    if (auto n = AssignedIdentifier(exp->lhs.get())) {
+      if (auto it = local_uses_.find(n); it != local_uses_.end()) {
+        // The stored value may be truncated, so it gets a new number.
+        variables_[it->second] = NewValue();
+      }
+    }
+    value_ = NewValue();
+    pure_ = false;
+  }
+
+  void Visit(EqualityExpression* exp, bool lvalue) {
+    VisitBinary(exp, true);
+  }
+
+  void Visit(AdditiveExpression* exp, bool lvalue) {
+    VisitBinary(exp, exp->op == TokenType::kOpPlus);
+  }
+
+  void Visit(MultiplicativeExpression* exp, bool lvalue) {
+    VisitBinary(exp, exp->op == TokenType::kOpMult);
+  }
+
+  void Visit(FunctionCallExpression* exp, bool lvalue) {
+    auto name = std::dynamic_pointer_cast<Identifier>(exp->name);
+    bool pure = name && local_uses_.find(name.get()) == local_uses_.end() &&
+                pure_functions_.count(name->value);
+
+    std::vector<size_t> operands(exp->args.size());
+    for (auto i : ArgumentEvaluationOrder(exp)) {
+      exp->args[i]->Accept(this, false);
+      operands[i] = value_;
+      pure = pure && pure_;
+    }
+
+    if (pure) {
+      value_ = Number({ValueKind::kCall, name->value, operands}, exp);
+    } else {
+      values_.clear();
+      value_ = NewValue();
+    }
+    pure_ = pure;
+  }
+
+  void Visit(IntegerLiteral* exp, bool lvalue) {
+    value_ = Number({ValueKind::kLiteral, "",
+                     {static_cast<size_t>(exp->value)}}, nullptr);
+    pure_ = true;
+  }
+
+  void Visit(Identifier* exp, bool lvalue) {
+    if (auto it = local_uses_.find(exp); it != local_uses_.end()) {
+      // Parameters are not declared in the body, so they get a number on
+      // their first use.
+      auto [var, inserted] = variables_.insert({it->second, 0});
+      if (inserted) {
+        var->second = NewValue();
+      }
+      value_ = var->second;
+      pure_ = true;
+    } else {
+      value_ = NewValue();
+      pure_ = false;
+    }
+  }
+
+  void Visit(InitializerClause* clause, bool lvalue) {
+    clause->assign->Accept(this, lvalue);
+  }
+
+  // Maps pure compound expressions to their value numbers.
+  const std::map<const Expression*, size_t>& Values() const {
+    return expression_values_;
+  }
+
+ private:
+  enum class ValueKind {
+    kLiteral,
+    kBinary,
+    kCall,
+  };
+  using ValueKey = std::tuple<ValueKind, std::string, std::vector<size_t>>;
+
+  void VisitBinary(BinaryExpression* exp, bool commutative) {
+    exp->rhs->Accept(this, false);
+    size_t rhs = value_;
+    bool pure = pure_;
+    exp->lhs->Accept(this, false);
+    size_t lhs = value_;
+    pure = pure && pure_;
+
+    if (commutative && rhs < lhs) {
+      std::swap(lhs, rhs);
+    }
+    if (pure) {
+      value_ = Number({ValueKind::kBinary, "",
+                       {static_cast<size_t>(exp->op), lhs, rhs}}, exp);
+    } else {
+      value_ = NewValue();
+    }
+    pure_ = pure;
+  }
+
+  size_t NewValue() {
+    return next_value_++;
+  }
+
+  size_t Number(const ValueKey& key, const Expression* exp) {
+    auto [it, inserted] = values_.insert({key, 0});
+    if (inserted) {
+      it->second = NewValue();
+    }
+    if (exp) {
+      expression_values_[exp] = it->second;
+    }
+    return it->second;
+  }
+
+  const std::map<const Identifier*, size_t>& local_uses_;
+  const std::set<std::string>& pure_functions_;
+  std::map<ValueKey, size_t> values_;
+  std::map<size_t, size_t> variables_; // local variable index -> value number
+  std::map<const Expression*, size_t> expression_values_;
+  size_t next_value_ = 0;
+  size_t value_ = 0;
+  bool pure_ = false;
+};
+
+// Finds pure compound expressions whose value has already been computed.
+// The first evaluation of such a value saves it and the later ones reuse it
+// without evaluating their operands.
+class CommonSubexpressionVisitor : public BaseVisitor {
+ public:
+  struct Value {
+    const Expression* first;
+    size_t first_point, last_use;
+    std::vector<const Expression*> reuses;
+  };
+
+  CommonSubexpressionVisitor(const std::map<const Expression*, size_t>& values)
+      : expression_values_{values} {
+  }
+
+  void Visit(CompoundStatement* stmt, bool lvalue) {
+    for (auto& n : stmt->statements) {
+      n->Accept(this, lvalue);
+    }
+  }
+
+  void Visit(ExpressionStatement* stmt, bool lvalue) {
+    ++point_;
+    stmt->exp->Accept(this, false);
+  }
+
+  void Visit(DeclarationStatement* stmt, bool lvalue) {
+    ++point_;
+    stmt->decl->Accept(this, false);
+  }
+
+  void Visit(SimpleDeclaration* decl, bool lvalue) {
+    for (const auto& init_decl : decl->dtors) {
+      InitDeclaratorVisitor v;
+      init_decl->Accept(&v, false);
+      if (auto clause = v.InitializerClause()) {
+        clause->Accept(this, false);
+      }
+    }
+  }
+
+  void Visit(AssignmentExpression* exp, bool lvalue) {
+    exp->rhs->Accept(this, false);
+    exp->lhs->Accept(this, true);
+  }
+
+  void Visit(EqualityExpression* exp, bool lvalue) {
+    VisitBinary(exp);
+  }
+
+  void Visit(AdditiveExpression* exp, bool lvalue) {
+    VisitBinary(exp);
+  }
+
+  void Visit(MultiplicativeExpression* exp, bool lvalue) {
+    VisitBinary(exp);
+  }
+
+  void Visit(FunctionCallExpression* exp, bool lvalue) {
+    if (Reuse(exp)) {
+      return;
+    }
+    for (auto i : ArgumentEvaluationOrder(exp)) {
+      exp->args[i]->Accept(this, false);
+    }
+  }
+
+  void Visit(InitializerClause* clause, bool lvalue) {
+    clause->assign->Accept(this, lvalue);
+  }
+
+  // Values which are reused at least once.
+  std::vector<Value> ReusedValues() const {
+    std::vector<Value> reused;
+    for (const auto& [number, value] : values_) {
+      if (!value.reuses.empty()) {
+        reused.push_back(value);
+      }
+    }
+    return reused;
+  }
+
+ private:
+  void VisitBinary(BinaryExpression* exp) {
+    if (Reuse(exp)) {
+      return;
+    }
+    exp->rhs->Accept(this, false);
+    exp->lhs->Accept(this, false);
+  }
+
+  // Returns true if exp reuses a value computed before.
+  bool Reuse(const Expression* exp) {
+    auto it = expression_values_.find(exp);
+    if (it == expression_values_.end()) {
+      return false;
+    }
+    auto [value, inserted] = values_.insert({it->second, {}});
+    if (inserted) {
+      value->second = {exp, point_, point_, {}};
+      return false;
+    }
+    value->second.last_use = point_;
+    value->second.reuses.push_back(exp);
+    return true;
+  }
+
+  const std::map<const Expression*, size_t>& expression_values_;
+  std::map<size_t, Value> values_;
+  size_t point_ = 0;
+};
+
+// Identifiers declared at namespace scope. Collected before generating code
+// for function definitions, and shared by them.
+struct GlobalScope {
+  struct GlobalId {
+    IdInfo info;
+    size_t decl_index; // index of the first declaration in TranslationUnit::decls
+    bool defined;      // defined in this translation unit
+    bool internal;     // declared static, so invisible to other modules
+  };
+  std::map<std::string, GlobalId> ids;
+  std::set<std::string> pure_functions;
+  std::string pure_digest; // hash of the pure function definitions
+};
+
+// Evaluates expressions and calls of pure functions at compile time, as the
+// generated code computes them: 32-bit arithmetic which wraps around, signed
+// division which truncates toward zero, and char variables which keep the low
+// byte. A division by zero or of INT32_MIN by -1 traps in the generated code,
+// so it is not evaluated but left to run time.
+//
+// An evaluation fails if it needs a value not known at compile time, takes
+// more than kMaxSteps nodes, or nests calls deeper than kMaxDepth; a function
+// body has no conditions, so a recursive call never ends. Results of calls are
+// memoized.
+class Interpreter {
+ public:
+  Interpreter(const TranslationUnit& unit, const GlobalScope& globals)
+      : globals_{globals} {
+    for (const auto& decl : unit.decls) {
+      auto defn = std::dynamic_pointer_cast<FunctionDefinition>(decl);
+      if (!defn) {
+        continue;
+      }
+      InitDeclaratorVisitor v;
+      defn->dtor->Accept(&v, false);
+      if (v.Identifier() && globals.pure_functions.count(v.Identifier()->value)) {
+        definitions_[v.Identifier()->value] = defn.get();
+      }
+    }
+  }
+
+  // Evaluates exp, an expression without variables in the decl_index-th
+  // declaration. Only the functions declared before it may be called.
+  bool Evaluate(const Expression* exp, size_t decl_index, int32_t& value) {
+    Frame frame;
+    decl_index_ = decl_index;
+    steps_ = 0;
+    depth_ = 0;
+    limited_ = false;
+    return Eval(exp, frame, value);
+  }
+
+ private:
+  static const size_t kMaxSteps = 100000;
+  static const size_t kMaxDepth = 64;
+
+  struct Variable {
+    int32_t value;
+    bool initialized;
+    bool is_char;
+  };
+  using Frame = std::vector<std::map<std::string, Variable>>;
+
+  static Variable* Find(Frame& frame, const std::string& id_name) {
+    for (auto it = frame.rbegin(); it != frame.rend(); ++it) {
+      if (auto found = it->find(id_name); found != it->end()) {
+        return &found->second;
+      }
+    }
+    return nullptr;
+  }
+
+  static int32_t Store(Variable& var, int32_t value) {
+    var.value = var.is_char ? static_cast<int8_t>(value) : value;
+    var.initialized = true;
+    return var.value;
+  }
+
+  bool Eval(const Expression* exp, Frame& frame, int32_t& value) {
+    if (++steps_ > kMaxSteps) {
+      limited_ = true;
+      return false;
+    }
+    if (auto n = dynamic_cast<const IntegerLiteral*>(exp)) {
+      value = n->value;
+      return true;
+    }
+    if (auto n = dynamic_cast<const Identifier*>(exp)) {
+      auto var = Find(frame, n->value);
+      if (!var || !var->initialized) {
+        return false;
+      }
+      value = var->value;
+      return true;
+    }
+    if (auto n = dynamic_cast<const FunctionCallExpression*>(exp)) {
+      return EvalCall(n, frame, value);
+    }
+    auto n = dynamic_cast<const BinaryExpression*>(exp);
+    if (!n) {
+      return false;
+    }
+    // The operands are evaluated in the order of the generated code.
+    int32_t lhs, rhs;
+    if (!Eval(n->rhs.get(), frame, rhs)) {
+      return false;
+    }
+    if (dynamic_cast<const AssignmentExpression*>(exp)) {
+      auto id = std::dynamic_pointer_cast<Identifier>(n->lhs);
+      auto var = id ? Find(frame, id->value) : nullptr;
+      if (!var) {
+        return false;
+      }
+      value = Store(*var, rhs);
+      return true;
+    }
+    if (!Eval(n->lhs.get(), frame, lhs)) {
+      return false;
+    }
+    uint32_t ulhs = lhs, urhs = rhs;
+    if (n->op == TokenType::kOpEqual) {
+      value = lhs == rhs;
+    } else if (n->op == TokenType::kOpNotEqual) {
+      value = lhs != rhs;
+    } else if (n->op == TokenType::kOpPlus) {
+      value = ulhs + urhs;
+    } else if (n->op == TokenType::kOpMinus) {
+      value = ulhs - urhs;
+    } else if (n->op == TokenType::kOpMult) {
+      value = ulhs * urhs;
+    } else if (n->op == TokenType::kOpDiv && rhs != 0 &&
+               !(lhs == INT32_MIN && rhs == -1)) {
+      value = lhs / rhs;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  bool EvalCall(const FunctionCallExpression* exp, Frame& frame,
+                int32_t& value) {
+    auto name = std::dynamic_pointer_cast<Identifier>(exp->name);
+    if (!name || Find(frame, name->value)) {
+      return false;
+    }
+    auto defn = definitions_.find(name->value);
+    if (defn == definitions_.end() ||
+        (depth_ == 0 && globals_.ids.at(name->value).decl_index > decl_index_)) {
+      return false;
+    }
+    std::vector<int32_t> args(exp->args.size());
+    for (auto i : ArgumentEvaluationOrder(exp)) {
+      if (!Eval(exp->args[i]->assign.get(), frame, args[i])) {
+        return false;
+      }
+    }
+
+    auto key = std::make_pair(defn->second, args);
+    if (auto it = memo_.find(key); it != memo_.end()) {
+      value = it->second.second;
+      return it->second.first;
+    }
+    if (depth_ >= kMaxDepth) {
+      limited_ = true;
+      return false;
+    }
+    // Hitting a limit depends on the caller, so such a failure is not
+    // memoized.
+    bool limited = std::exchange(limited_, false);
+    ++depth_;
+    bool success = Call(*defn->second, args, value);
+    --depth_;
+    if (success || !limited_) {
+      memo_[key] = {success, value};
+    }
+    limited_ = limited_ || limited;
+    return success;
+  }
+
+  bool Call(const FunctionDefinition& defn, const std::vector<int32_t>& args,
+            int32_t& value) {
+    InitDeclaratorVisitor v;
+    defn.dtor->Accept(&v, false);
+    auto func_dtor = v.FunctionDeclarator();
+    if (!func_dtor || func_dtor->param->params.size() != args.size()) {
+      return false;
+    }
+    Frame frame(1);
+    for (size_t i = 0; i < args.size(); ++i) {
+      const auto& param = func_dtor->param->params[i];
+      DeclSpecifierVisitor param_spec;
+      param->spec->Accept(&param_spec, false);
+      InitDeclaratorVisitor param_dtor;
+      param->dtor->Accept(&param_dtor, false);
+      bool is_char = param_spec.SimpleTypeSpecifier()->type_info->size == 1;
+      Store(frame.back()[param_dtor.Identifier()->value] = {0, false, is_char},
+            args[i]);
+    }
+
+    // The value of a function is that of its last statement, or 0 if the body
+    // is empty.
+    auto body = std::dynamic_pointer_cast<CompoundStatement>(defn.body);
+    value = 0;
+    return body->statements.empty() || Exec(body.get(), frame, value);
+  }
+
+  // Executes stmt, leaving the value of the last expression statement in
+  // value. Fails if stmt does not end with an expression statement.
+  bool Exec(const Statement* stmt, Frame& frame, int32_t& value) {
+    if (auto n = dynamic_cast<const ExpressionStatement*>(stmt)) {
+      return Eval(n->exp.get(), frame, value);
+    }
+    if (auto n = dynamic_cast<const CompoundStatement*>(stmt)) {
+      frame.emplace_back();
+      bool success = !n->statements.empty();
+      for (const auto& s : n->statements) {
+        success = success && Exec(s.get(), frame, value);
+      }
+      frame.pop_back();
+      return success && dynamic_cast<const ExpressionStatement*>(
+                            n->statements.back().get()) != nullptr;
+    }
+    auto n = dynamic_cast<const DeclarationStatement*>(stmt);
+    auto decl = n ? std::dynamic_pointer_cast<SimpleDeclaration>(n->decl)
+                  : nullptr;
+    if (!decl) {
+      return false;
+    }
+    DeclSpecifierVisitor spec;
+    for (const auto& s : decl->specs) {
+      s->Accept(&spec, false);
+    }
+    for (const auto& init_decl : decl->dtors) {
+      InitDeclaratorVisitor v;
+      init_decl->Accept(&v, false);
+      if (v.FunctionDeclarator()) {
+        continue;
+      }
+      bool is_char = spec.SimpleTypeSpecifier()->type_info->size == 1;
+      auto& var = frame.back()[v.Identifier()->value] = {0, false, is_char};
+      int32_t init;
+      if (auto clause = v.InitializerClause()) {
+        if (!Eval(clause->assign.get(), frame, init)) {
+          return false;
+        }
+        Store(var, init);
+      }
+    }
+    return true;
+  }
+
+  const GlobalScope& globals_;
+  std::map<std::string, const FunctionDefinition*> definitions_;
+  std::map<std::pair<const FunctionDefinition*, std::vector<int32_t>>,
+           std::pair<bool, int32_t>> memo_;
+  size_t decl_index_ = 0;
+  size_t steps_ = 0;
+  size_t depth_ = 0;
+  bool limited_ = false; // a limit was hit
+};
+
+// Replaces the constant subexpressions of a function body, including calls of
+// pure functions with constant arguments, by integer literals. The analyses
+// and the code generation which follow see the literals only.
+class ConstantFolder {
+ public:
+  ConstantFolder(Interpreter& interpreter, size_t decl_index)
+      : interpreter_{interpreter}, decl_index_{decl_index} {
+  }
+
+  // The parameters in constant_params are replaced by their values.
+  void Fold(FunctionDefinition* defn,
+            const std::map<std::string, int32_t>& constant_params = {}) {
+    constant_params_ = &constant_params;
+    InitDeclaratorVisitor v;
+    defn->dtor->Accept(&v, false);
+    scopes_.assign(1, {});
+    if (auto func_dtor = v.FunctionDeclarator()) {
+      for (const auto& param : func_dtor->param->params) {
+        InitDeclaratorVisitor param_dtor;
+        param->dtor->Accept(&param_dtor, false);
+        scopes_.back().insert(param_dtor.Identifier()->value);
+      }
+    }
+    FoldStatement(defn->body.get());
+  }
+
+ private:
+  void FoldStatement(Statement* stmt) {
+    if (auto n = dynamic_cast<ExpressionStatement*>(stmt)) {
+      FoldExpression(n->exp);
+    } else if (auto n = dynamic_cast<CompoundStatement*>(stmt)) {
+      scopes_.emplace_back();
+      for (const auto& s : n->statements) {
+        FoldStatement(s.get());
+      }
+      scopes_.pop_back();
+    } else if (auto n = dynamic_cast<DeclarationStatement*>(stmt)) {
+      auto decl = std::dynamic_pointer_cast<SimpleDeclaration>(n->decl);
+      for (const auto& init_decl : decl->dtors) {
+        InitDeclaratorVisitor v;
+        init_decl->Accept(&v, false);
+        if (!v.FunctionDeclarator()) {
+          scopes_.back().insert(v.Identifier()->value);
+        }
+        if (auto clause = v.InitializerClause()) {
+          FoldExpression(clause->assign);
+        }
+      }
+    }
+  }
+
+  // Folds the operands of exp, then exp itself if they are all literals.
+  void FoldExpression(std::shared_ptr<Expression>& exp) {
+    bool constant = false;
+    if (auto n = std::dynamic_pointer_cast<AssignmentExpression>(exp)) {
+      FoldExpression(n->rhs);
+    } else if (auto n = std::dynamic_pointer_cast<BinaryExpression>(exp)) {
+      FoldExpression(n->lhs);
+      FoldExpression(n->rhs);
+      constant = IsLiteral(n->lhs) && IsLiteral(n->rhs);
+    } else if (auto n = std::dynamic_pointer_cast<FunctionCallExpression>(exp)) {
+      constant = true;
+      for (const auto& arg : n->args) {
+        FoldExpression(arg->assign);
+        constant = constant && IsLiteral(arg->assign);
+      }
+      auto name = std::dynamic_pointer_cast<Identifier>(n->name);
+      constant = constant && name && !IsLocal(name->value);
+    } else if (auto n = std::dynamic_pointer_cast<Identifier>(exp)) {
+      // Parameters are in the outermost scope.
+      auto it = constant_params_->find(n->value);
+      if (it != constant_params_->end() && !IsLocal(n->value, 1)) {
+        auto literal = std::make_shared<IntegerLiteral>();
+        literal->value = it->second;
+        exp = literal;
+      }
+      return;
+    }
+
+    int32_t value;
+    if (constant && interpreter_.Evaluate(exp.get(), decl_index_, value)) {
+      auto literal = std::make_shared<IntegerLiteral>();
+      literal->value = value;
+      exp = literal;
+    }
+  }
+
+  static bool IsLiteral(const std::shared_ptr<Expression>& exp) {
+    return dynamic_cast<const IntegerLiteral*>(exp.get()) != nullptr;
+  }
+
+  // Returns true if id_name is declared in the first_scope-th or an inner
+  // scope.
+  bool IsLocal(const std::string& id_name, size_t first_scope = 0) const {
+    return std::any_of(scopes_.begin() + std::min(first_scope, scopes_.size()),
+                       scopes_.end(),
+        [&](const std::set<std::string>& scope) { return scope.count(id_name); });
+  }
+
+  Interpreter& interpreter_;
+  size_t decl_index_;
+  const std::map<std::string, int32_t>* constant_params_ = nullptr;
+  std::vector<std::set<std::string>> scopes_;
+};
+
+// Collects the calls in a function body with the values of their arguments,
+// which are known for literals, and the other names used in it.
+class CallSiteVisitor : public FunctionBodyVisitor {
+ public:
+  struct CallSite {
+    const FunctionCallExpression* exp;
+    std::string callee;
+    std::vector<std::optional<int32_t>> args;
+  };
+
+  void Visit(FunctionCallExpression* exp, bool lvalue) {
+    if (auto name = std::dynamic_pointer_cast<Identifier>(exp->name)) {
+      CallSite site{exp, name->value, {}};
+      for (const auto& arg : exp->args) {
+        auto literal = dynamic_cast<const IntegerLiteral*>(arg->assign.get());
+        site.args.push_back(literal ? std::optional<int32_t>{literal->value}
+                                    : std::nullopt);
+      }
+      calls_.push_back(site);
+    } else {
+      exp->name->Accept(this, lvalue);
+    }
+    for (const auto& arg : exp->args) {
+      arg->Accept(this, lvalue);
+    }
+  }
+
+  void Visit(AssignmentExpression* exp, bool lvalue) {
+    if (auto n = std::dynamic_pointer_cast<Identifier>(exp->lhs)) {
+      assigned_.insert(n->value);
+    }
+    FunctionBodyVisitor::Visit(exp, lvalue);
+  }
+
+  void Visit(Identifier* exp, bool lvalue) {
+    names_.insert(exp->value);
+  }
+
+  // The calls of functions by name, in the order of the names in the source.
+  const std::vector<CallSite>& Calls() const {
+    return calls_;
+  }
+
+  // Identifiers used other than as the name of a called function.
+  const std::set<std::string>& Names() const {
+    return names_;
+  }
+
+  // Identifiers assigned to.
+  const std::set<std::string>& Assigned() const {
+    return assigned_;
+  }
+
+ private:
+  std::vector<CallSite> calls_;
+  std::set<std::string> names_;
+  std::set<std::string> assigned_;
+};
+
+// Optimizes across the function definitions of a translation unit with its
+// call graph. Functions with external linkage may be called from other
+// modules, so they are the roots of the graph.
+//
+// Static functions which no root reaches are dead and need no code. A
+// parameter of a live static function, for which every call site passes the
+// same literal and which the function never assigns, is replaced by the
+// literal. The function is folded again, which may make the arguments of its
+// own calls constant, so this repeats until nothing changes. The arguments are
+// still passed, so the calling convention does not change.
+class InterproceduralOptimizer {
+ public:
+  InterproceduralOptimizer(const TranslationUnit& unit,
+                           const GlobalScope& globals, Interpreter& interpreter)
+      : globals_{globals}, interpreter_{interpreter} {
+    for (size_t i = 0; i < unit.decls.size(); ++i) {
+      auto defn = std::dynamic_pointer_cast<FunctionDefinition>(unit.decls[i]);
+      if (!defn) {
+        continue;
+      }
+      InitDeclaratorVisitor v;
+      defn->dtor->Accept(&v, false);
+      if (!v.Identifier() || !v.FunctionDeclarator()) {
+        continue;
+      }
+      auto& function = functions_[v.Identifier()->value];
+      function.decl_index = i;
+      function.defn = defn.get();
+      for (const auto& param : v.FunctionDeclarator()->param->params) {
+        DeclSpecifierVisitor param_spec;
+        param->spec->Accept(&param_spec, false);
+        InitDeclaratorVisitor param_dtor;
+        param->dtor->Accept(&param_dtor, false);
+        function.params.push_back(
+            {param_dtor.Identifier()->value,
+             param_spec.SimpleTypeSpecifier()->type_info->size == 1});
+      }
+      defn->body->Accept(&function.sites, false);
+    }
+  }
+
+  void Run() {
+    for (bool changed = true; changed; ) {
+      FindLiveFunctions();
+      changed = false;
+      for (auto& [name, function] : functions_) {
+        changed = PropagateConstants(name, function) || changed;
+      }
+    }
+  }
+
+  bool IsLive(size_t decl_index) const {
+    return live_.count(decl_index);
+  }
+
+  // Collects the calls of the decl_index-th declaration again after its body
+  // was changed. The next Run() takes them into account.
+  void Rescan(size_t decl_index) {
+    for (auto& [name, function] : functions_) {
+      if (function.decl_index == decl_index) {
+        function.sites = CallSiteVisitor{};
+        function.defn->body->Accept(&function.sites, false);
+      }
+    }
+  }
+
+  // Parameters of the decl_index-th declaration replaced by constants.
+  const std::map<std::string, int32_t>& ConstantParams(size_t decl_index) const {
+    static const std::map<std::string, int32_t> kNone;
+    for (const auto& [name, function] : functions_) {
+      if (function.decl_index == decl_index) {
+        return function.constant_params;
+      }
+    }
+    return kNone;
+  }
+
+ private:
+  struct Param {
+    std::string id_name;
+    bool is_char;
+  };
+
+  struct Function {
+    size_t decl_index;
+    FunctionDefinition* defn;
+    std::vector<Param> params;
+    CallSiteVisitor sites;
+    std::map<std::string, int32_t> constant_params;
+  };
+
+  bool IsInternal(const std::string& name) const {
+    auto it = globals_.ids.find(name);
+    return it != globals_.ids.end() && it->second.internal;
+  }
+
+  void FindLiveFunctions() {
+    live_.clear();
+    std::vector<const Function*> worklist;
+    std::set<std::string> reached;
+    auto reach = [&](const std::string& name) {
+      auto it = functions_.find(name);
+      if (it != functions_.end() && reached.insert(name).second) {
+        worklist.push_back(&it->second);
+      }
+    };
+    for (const auto& [name, function] : functions_) {
+      if (!IsInternal(name)) {
+        reach(name);
+      }
+    }
+    while (!worklist.empty()) {
+      auto function = worklist.back();
+      worklist.pop_back();
+      live_.insert(function->decl_index);
+      for (const auto& site : function->sites.Calls()) {
+        reach(site.callee);
+      }
+      for (const auto& name : function->sites.Names()) {
+        reach(name);
+      }
+    }
+  }
+
+  // Returns true if a parameter of function is found to be constant.
+  bool PropagateConstants(const std::string& name, Function& function) {
+    if (!IsInternal(name) || !live_.count(function.decl_index)) {
+      return false;
+    }
+    std::vector<const CallSiteVisitor::CallSite*> sites;
+    for (const auto& [caller_name, caller] : functions_) {
+      if (!live_.count(caller.decl_index)) {
+        continue;
+      }
+      // A function whose address is taken may be called with any arguments.
+      if (caller.sites.Names().count(name)) {
+        return false;
+      }
+      for (const auto& site : caller.sites.Calls()) {
+        if (site.callee == name) {
+          sites.push_back(&site);
+        }
+      }
+    }
+    if (sites.empty()) {
+      return false;
+    }
+
+    bool found = false;
+    for (size_t i = 0; i < function.params.size(); ++i) {
+      const auto& param = function.params[i];
+      if (function.constant_params.count(param.id_name) ||
+          function.sites.Assigned().count(param.id_name)) {
+        continue;
+      }
+      auto value = sites[0]->args.size() == function.params.size()
+                   ? sites[0]->args[i] : std::nullopt;
+      bool constant = value && std::all_of(sites.begin(), sites.end(),
+          [&](const CallSiteVisitor::CallSite* site) {
+            return site->args.size() == function.params.size() &&
+                   site->args[i] == value;
+          });
+      if (constant) {
+        function.constant_params[param.id_name] =
+            param.is_char ? static_cast<int8_t>(*value) : *value;
+        found = true;
+      }
+    }
+    if (found) {
+      ConstantFolder folder{interpreter_, function.decl_index};
+      folder.Fold(function.defn, function.constant_params);
+      function.sites = CallSiteVisitor{};
+      function.defn->body->Accept(&function.sites, false);
+    }
+    return found;
+  }
+
+  const GlobalScope& globals_;
+  Interpreter& interpreter_;
+  std::map<std::string, Function> functions_;
+  std::set<size_t> live_; // indices of the live function definitions
+};
+
+// Counts read from a profile, which a program built with -fprofile-generate
+// writes as it exits. See runtime/profile.cpp for the format.
+class Profile {
+ public:
+  bool Read(const std::string& path) {
+    std::ifstream in{path};
+    if (!in) {
+      return false;
+    }
+    std::string name;
+    uint64_t count;
+    while (in >> name >> count) {
+      counts_[name] += count;
+    }
+    // The hottest functions which together take kHotPercent percent of all
+    // calls are hot. The threshold is the count of the least called of them.
+    std::vector<uint64_t> entry_counts;
+    uint64_t total = 0;
+    for (const auto& [name, count] : counts_) {
+      if (name.find('#') == std::string::npos) {
+        entry_counts.push_back(count);
+        total += count;
+      }
+    }
+    std::sort(entry_counts.begin(), entry_counts.end(), std::greater<>{});
+    uint64_t covered = 0;
+    for (auto count : entry_counts) {
+      hot_threshold_ = count;
+      covered += count;
+      if (covered * 100 >= total * kHotPercent) {
+        break;
+      }
+    }
+    return true;
+  }
+
+  // Returns the count of calls of a function, or nullopt if the profile does
+  // not know the function.
+  std::optional<uint64_t> EntryCount(const std::string& function) const {
+    auto it = counts_.find(function);
+    if (it == counts_.end()) {
+      return std::nullopt;
+    }
+    return it->second;
+  }
+
+  // Returns the count of the site_index-th call in a function.
+  uint64_t SiteCount(const std::string& function, size_t site_index) const {
+    auto it = counts_.find(function + '#' + std::to_string(site_index));
+    return it == counts_.end() ? 0 : it->second;
+  }
+
+  // Returns true if count is at least the count of the least called hot
+  // function.
+  bool IsHot(uint64_t count) const {
+    return count > 0 && count >= hot_threshold_;
+  }
+
+ private:
+  static const uint64_t kHotPercent = 90;
+
+  std::map<std::string, uint64_t> counts_;
+  uint64_t hot_threshold_ = 0;
+};
+
+// Replaces calls by the expressions which the called functions compute.
+//
+// A function is inlined if its body is a single expression statement with no
+// assignments, and it has no char parameters, which would truncate the
+// arguments. The arguments must be literals or local variables of the caller,
+// which the expression cannot change, so they may be evaluated where the
+// parameters are used rather than before the call. The names the expression
+// uses must refer to the same declarations at the call.
+class Inliner {
+ public:
+  Inliner(const TranslationUnit& unit, const GlobalScope& globals)
+      : globals_{globals} {
+    for (size_t i = 0; i < unit.decls.size(); ++i) {
+      auto defn = std::dynamic_pointer_cast<FunctionDefinition>(unit.decls[i]);
+      if (!defn) {
+        continue;
+      }
+      InitDeclaratorVisitor v;
+      defn->dtor->Accept(&v, false);
+      if (v.Identifier() && v.FunctionDeclarator()) {
+        callees_[v.Identifier()->value] = {i, defn.get(), v.FunctionDeclarator()};
+      }
+    }
+  }
+
+  // Inlines the calls in calls found in a function definition, the
+  // decl_index-th declaration, and adds the indices of the inlined definitions
+  // to inlined. Returns true if any call is inlined.
+  bool Inline(FunctionDefinition* defn, size_t decl_index,
+              const std::set<const FunctionCallExpression*>& calls,
+              std::set<size_t>& inlined) {
+    calls_ = &calls;
+    decl_index_ = decl_index;
+    inlined_ = &inlined;
+    any_inlined_ = false;
+    InitDeclaratorVisitor v;
+    defn->dtor->Accept(&v, false);
+    scopes_.assign(1, {});
+    if (auto func_dtor = v.FunctionDeclarator()) {
+      for (const auto& param : func_dtor->param->params) {
+        InitDeclaratorVisitor param_dtor;
+        param->dtor->Accept(&param_dtor, false);
+        scopes_.back().insert(param_dtor.Identifier()->value);
+      }
+    }
+    InlineStatement(defn->body.get());
+    return any_inlined_;
+  }
+
+ private:
+  struct Callee {
+    size_t decl_index;
+    FunctionDefinition* defn;
+    FunctionDeclarator* dtor;
+  };
+
+  void InlineStatement(Statement* stmt) {
+    if (auto n = dynamic_cast<ExpressionStatement*>(stmt)) {
+      InlineExpression(n->exp);
+    } else if (auto n = dynamic_cast<CompoundStatement*>(stmt)) {
+      scopes_.emplace_back();
+      for (const auto& s : n->statements) {
+        InlineStatement(s.get());
+      }
+      scopes_.pop_back();
+    } else if (auto n = dynamic_cast<DeclarationStatement*>(stmt)) {
+      auto decl = std::dynamic_pointer_cast<SimpleDeclaration>(n->decl);
+      for (const auto& init_decl : decl->dtors) {
+        InitDeclaratorVisitor v;
+        init_decl->Accept(&v, false);
+        if (!v.FunctionDeclarator()) {
+          scopes_.back().insert(v.Identifier()->value);
+        }
+        if (auto clause = v.InitializerClause()) {
+          InlineExpression(clause->assign);
+        }
+      }
+    }
+  }
+
+  void InlineExpression(std::shared_ptr<Expression>& exp) {
+    if (auto n = std::dynamic_pointer_cast<BinaryExpression>(exp)) {
+      InlineExpression(n->lhs);
+      InlineExpression(n->rhs);
+    } else if (auto n = std::dynamic_pointer_cast<FunctionCallExpression>(exp)) {
+      for (const auto& arg : n->args) {
+        InlineExpression(arg->assign);
+      }
+      if (calls_->count(n.get())) {
+        if (auto inlined = InlinedCall(*n)) {
+          exp = inlined;
+          any_inlined_ = true;
+        }
+      }
+    }
+  }
+
+  // Returns the expression of the callee with the arguments in place of the
+  // parameters, or null if the call cannot be inlined.
+  std::shared_ptr<Expression> InlinedCall(const FunctionCallExpression& call) {
+    auto name = std::dynamic_pointer_cast<Identifier>(call.name);
+    if (!name || IsLocal(name->value)) {
+      return nullptr;
+    }
+    auto it = callees_.find(name->value);
+    if (it == callees_.end() || !IsVisible(name->value)) {
+      return nullptr;
+    }
+    const auto& callee = it->second;
+    auto body = std::dynamic_pointer_cast<CompoundStatement>(callee.defn->body);
+    if (body->statements.size() != 1 ||
+        callee.dtor->param->params.size() != call.args.size()) {
+      return nullptr;
+    }
+    auto stmt = dynamic_cast<const ExpressionStatement*>(
+        body->statements[0].get());
+    if (!stmt) {
+      return nullptr;
+    }
+
+    std::map<std::string, const Expression*> args;
+    for (size_t i = 0; i < call.args.size(); ++i) {
+      const auto& param = callee.dtor->param->params[i];
+      DeclSpecifierVisitor param_spec;
+      param->spec->Accept(&param_spec, false);
+      InitDeclaratorVisitor param_dtor;
+      param->dtor->Accept(&param_dtor, false);
+      auto arg = call.args[i]->assign.get();
+      auto arg_id = dynamic_cast<const Identifier*>(arg);
+      if (param_spec.SimpleTypeSpecifier()->type_info->size == 1 ||
+          !(dynamic_cast<const IntegerLiteral*>(arg) ||
+            (arg_id && IsLocal(arg_id->value)))) {
+        return nullptr;
+      }
+      args[param_dtor.Identifier()->value] = arg;
+    }
+
+    CallSiteVisitor uses;
+    stmt->exp->Accept(&uses, false);
+    for (const auto& site : uses.Calls()) {
+      if (args.count(site.callee) || IsLocal(site.callee) ||
+          !IsVisible(site.callee)) {
+        return nullptr;
+      }
+    }
+    for (const auto& id_name : uses.Names()) {
+      if (!args.count(id_name) && (IsLocal(id_name) || !IsVisible(id_name))) {
+        return nullptr;
+      }
+    }
+    auto inlined = Clone(*stmt->exp, args);
+    if (inlined) {
+      inlined_->insert(callee.decl_index);
+    }
+    return inlined;
+  }
+
+  // Returns a copy of exp made of new nodes, with the identifiers in args
+  // replaced by copies of their values, or null if exp has an assignment.
+  static std::shared_ptr<Expression> Clone(
+      const Expression& exp,
+      const std::map<std::string, const Expression*>& args) {
+    if (auto n = dynamic_cast<const IntegerLiteral*>(&exp)) {
+      return std::make_shared<IntegerLiteral>(*n);
+    } else if (auto n = dynamic_cast<const Identifier*>(&exp)) {
+      auto it = args.find(n->value);
+      return it == args.end() ? std::make_shared<Identifier>(*n)
+                              : Clone(*it->second, {});
+    } else if (auto n = dynamic_cast<const EqualityExpression*>(&exp)) {
+      return CloneBinary(*n, args);
+    } else if (auto n = dynamic_cast<const AdditiveExpression*>(&exp)) {
+      return CloneBinary(*n, args);
+    } else if (auto n = dynamic_cast<const MultiplicativeExpression*>(&exp)) {
+      return CloneBinary(*n, args);
+    } else if (auto n = dynamic_cast<const FunctionCallExpression*>(&exp)) {
+      auto call = std::make_shared<FunctionCallExpression>();
+      call->name = Clone(*n->name, args);
+      bool cloned = call->name != nullptr;
+      for (const auto& arg : n->args) {
+        auto clause = std::make_shared<InitializerClause>();
+        clause->assign = Clone(*arg->assign, args);
+        cloned = cloned && clause->assign;
+        call->args.push_back(clause);
+      }
+      return cloned ? call : nullptr;
+    }
+    return nullptr;
+  }
+
+  template <typename T>
+  static std::shared_ptr<Expression> CloneBinary(
+      const T& exp, const std::map<std::string, const Expression*>& args) {
+    auto copy = std::make_shared<T>();
+    copy->op = exp.op;
+    copy->lhs = Clone(*exp.lhs, args);
+    copy->rhs = Clone(*exp.rhs, args);
+    return copy->lhs && copy->rhs ? copy : nullptr;
+  }
+
+  bool IsLocal(const std::string& id_name) const {
+    return std::any_of(scopes_.begin(), scopes_.end(),
+        [&](const std::set<std::string>& scope) { return scope.count(id_name); });
+  }
+
+  // Returns true if the global id_name is declared before the caller.
+  bool IsVisible(const std::string& id_name) const {
+    auto it = globals_.ids.find(id_name);
+    return it != globals_.ids.end() && it->second.decl_index <= decl_index_;
+  }
+
+  const GlobalScope& globals_;
+  std::map<std::string, Callee> callees_;
+  const std::set<const FunctionCallExpression*>* calls_ = nullptr;
+  size_t decl_index_ = 0;
+  std::set<size_t>* inlined_ = nullptr;
+  bool any_inlined_ = false;
+  std::vector<std::set<std::string>> scopes_;
+};
+
+// What the code generation of a function definition does besides compiling
+// its body, decided for the whole translation unit beforehand.
+struct FunctionPlan {
+  // The calls of the function and of its call sites are counted.
+  bool instrument = false;
+  // Index of the counter of each call site, counter 0 counting the calls of
+  // the function.
+  std::map<const FunctionCallExpression*, long> counters;
+  // The section for the code if not .text.
+  const char* section = nullptr;
+  // Indices of the definitions inlined into the function, whose code is then
+  // part of its code.
+  std::set<size_t> inlined;
+};
+
+// Prefix of the symbol of the counters of a function.
+const char kCountersPrefix[] = "__9cxx_prof_";
+
+// The common information entry of the frame descriptions in .eh_frame, which
+// CodeGenerator writes before the functions. The CFA is rsp + 8 and the return
+// address is at CFA - 8, as at the entry of a function.
+const char kCieSymbol[] = "__9cxx_cie";
+const char kEhFrameSection[] =
+    "section .eh_frame progbits alloc noexec nowrite align=8";
+
+// The attributes of the sections of FunctionPlan::section, which NASM knows
+// only for .text itself.
+const char kCodeSectionAttributes[] = " progbits alloc exec nowrite align=16";
+
+// The function of runtime/profile.cpp to which the table of counters of each
+// instrumented translation unit is passed.
+const std::string kProfileRegister{"__9cxx_profile_register"};
+
+// Generates code for a function definition, the decl_index-th declaration of
+// the translation unit.
+class CodeGenerateVisitor : public BaseVisitor {
+ public:
+  CodeGenerateVisitor(CodeBuffer& code,
+                      std::vector<Diagnostic>& diagnostics,
+                      const CompileOptions& options,
+                      const GlobalScope& globals, size_t decl_index,
+                      const FunctionPlan& plan)
+      : code_{code}, diagnostics_{diagnostics}, options_{options},
+        globals_{globals}, decl_index_{decl_index}, plan_{plan}, ids_{},
+        locals_{} {
+  }
+
+  void Visit(CompoundStatement* stmt, bool lvalue) {
+    for (auto& n : stmt->statements) {
+      n->Accept(this, lvalue);
+    }
+  }
+
+  void Visit(ExpressionStatement* stmt, bool lvalue) {
+    stmt->exp->Accept(this, lvalue);
+  }
+
+  void Visit(DeclarationStatement* stmt, bool lvalue) {
+    stmt->decl->Accept(this, lvalue);
+  }
+
+  void Visit(AssignmentExpression* exp, bool lvalue) {
+    if (auto n = std::dynamic_pointer_cast<Identifier>(exp->lhs)) {
+      if (!FindId(n.get())) {
+        Error("Undeclared identifier: " + n->value);
+        return;
+      }
+    }
+
+    if (auto n = std::dynamic_pointer_cast<Identifier>(exp->lhs);
+        n && IsVariable(*FindId(n.get()))) {
+      const auto& id_info = *FindId(n.get());
+      exp->rhs->Accept(this, false);
+      StoreVariable(n->value, id_info);
+      if (lvalue) {
+        LoadAddress(n->value, id_info);
+      } else if (id_info.type_info->size == 1) {
+        code_.Line("  movsx eax, al");
+      }
+      return;
+    }
+
+    // The left side is an assignment, whose address is that of its variable.
+    auto id = AssignedIdentifier(exp->lhs.get());
+    auto id_info = id ? FindId(id) : nullptr;
+    if (!id_info || !IsVariable(*id_info)) {
+      Error("Cannot assign to the left side of =");
+      return;
+    }
+    bool is_char = id_info->type_info->size == 1;
+
+    exp->rhs->Accept(this, false);
+    Push("rax");
+    exp->lhs->Accept(this, true);
+    Pop("r11");
+
+    code_.Line(is_char ? "  mov [rax], r11b" : "  mov [rax], r11d");
+    if (is_char && !lvalue) {
+      code_.Line("  movsx eax, r11b");
+    } else if (!lvalue) {
+      code_.Line("  mov eax, r11d");
+    }
+  }
+
+  void Visit(EqualityExpression* exp, bool lvalue) {
+    if (LoadSavedValue(exp)) {
+      return;
+    }
+
+    exp->rhs->Accept(this, lvalue);
+    Push("rax");
+    exp->lhs->Accept(this, lvalue);
+    Pop("r11");
+
+    const char* op_mnemonic = "";
+    if (exp->op == TokenType::kOpEqual) {
+      op_mnemonic = "sete";
+    } else if (exp->op == TokenType::kOpNotEqual) {
+      op_mnemonic = "setne";
+    }
+    code_.Line("  cmp eax, r11d");
+    code_.Line("  ", op_mnemonic, " r11b");
+    code_.Line("  xor rax, rax");
+    code_.Line("  mov al, r11b");
+    SaveValue(exp);
+  }
+
+  void Visit(AdditiveExpression* exp, bool lvalue) {
+    if (LoadSavedValue(exp)) {
+      return;
+    }
+
+    exp->rhs->Accept(this, lvalue);
+    Push("rax");
+    exp->lhs->Accept(this, lvalue);
+    Pop("r11");
+
+    const char* op_mnemonic = "";
+    if (exp->op == TokenType::kOpPlus) {
+      op_mnemonic = "add";
+    } else if (exp->op == TokenType::kOpMinus) {
+      op_mnemonic = "sub";
+    }
+    code_.Line("  ", op_mnemonic, " eax, r11d");
+    SaveValue(exp);
+  }
+
+  void Visit(MultiplicativeExpression* exp, bool lvalue) {
+    if (LoadSavedValue(exp)) {
+      return;
+    }
+
+    exp->rhs->Accept(this, lvalue);
+    Push("rax");
+    exp->lhs->Accept(this, lvalue);
+    Pop("r11");
+
+    // Division is signed: cdq extends the sign of the dividend into edx.
+    if (exp->op == TokenType::kOpMult) {
+      code_.Line("  xor rdx, rdx");
+      code_.Line("  mul r11d");
+    } else if (exp->op == TokenType::kOpDiv) {
+      code_.Line("  cdq");
+      code_.Line("  idiv r11d");
+    }
+    SaveValue(exp);
+  }
+
+  void Visit(FunctionCallExpression* exp, bool lvalue) {
+    if (auto n = std::dynamic_pointer_cast<Identifier>(exp->name)) {
+      if (!FindId(n.get())) {
+        Error("Undeclared identifier: " + n->value);
+        return;
+      }
+    }
+
+    if (LoadSavedValue(exp)) {
+      return;
+    }
+
+    // rsp must be aligned to 16 bytes at the call, after pushing the stack
+    // arguments.
+    size_t num_stack_args = exp->args.size() > kParamRegList.size()
+                            ? exp->args.size() - kParamRegList.size() : 0;
+    size_t padding = (stack_depth_ + num_stack_args) % 2 ? 8 : 0;
+    if (padding > 0) {
+      code_.Line("  sub rsp, ", padding);
+      ++stack_depth_;
+    }
+
+    // The last register argument containing calls need not be pushed, unless
+    // it goes to rdx which the following arguments may clobber.
+    auto order = ArgumentEvaluationOrder(exp);
+    std::vector<bool> calls(exp->args.size());
+    size_t last_calling_reg_arg = exp->args.size();
+    for (auto i : order) {
+      CalleeVisitor v;
+      exp->args[i]->Accept(&v, false);
+      calls[i] = v.Calls();
+      if (calls[i] && i < kParamRegList.size()) {
+        last_calling_reg_arg = i;
+      }
+    }
+
+    std::vector<size_t> pushed_reg_args;
+    for (auto i : order) {
+      exp->args[i]->Accept(this, false);
+      if (i >= kParamRegList.size()) {
+        Push("rax");
+      } else if (calls[i] &&
+                 (i != last_calling_reg_arg || i == kRdxParamIndex)) {
+        Push("rax");
+        pushed_reg_args.push_back(i);
+      } else {
+        code_.Line("  mov ", kParamReg32List[i], ", eax");
+      }
+    }
+    for (auto it = pushed_reg_args.rbegin(); it != pushed_reg_args.rend(); ++it) {
+      Pop(kParamRegList[*it].c_str());
+    }
+
+    if (auto it = plan_.counters.find(exp); it != plan_.counters.end()) {
+      IncrementCounter(it->second);
+    }
+    auto callee = std::dynamic_pointer_cast<Identifier>(exp->name);
+    if (callee && FindId(callee.get())->type == IdType::kGlobal) {
+      auto symbol = ExternName(callee->value, options_);
+      // Mach-O has no PLT relocation; the linker adds stubs by itself.
+      if (options_.pic_mode != PicMode::kNone && IsElf(options_) &&
+          UsesGot(callee->value)) {
+        code_.Line("  call ", symbol, " wrt ..plt");
+      } else {
+        code_.Line("  call ", symbol);
+      }
+    } else {
+      exp->name->Accept(this, true);
+      code_.Line("  call rax");
+    }
+
+    size_t stack_args_size = 8 * num_stack_args + padding;
+    if (stack_args_size > 0) {
+      code_.Line("  add rsp, ", stack_args_size);
+      stack_depth_ -= stack_args_size / 8;
+    }
+    SaveValue(exp);
+  }
+
+  void Visit(IntegerLiteral* exp, bool lvalue) {
+    code_.Line("  mov eax, ", exp->value);
+  }
+
+  void Visit(Identifier* exp, bool lvalue) {
+    const auto& id_name = exp->value;
+    auto id_info_ptr = FindId(exp);
+
+    if (!id_info_ptr) {
+      Error("Undefined symbol: " + id_name);
+    } else if (IsVariable(*id_info_ptr)) {
+      if (lvalue) {
+        LoadAddress(id_name, *id_info_ptr);
+      } else {
+        LoadVariable(id_name, *id_info_ptr);
+      }
+    } else if (id_info_ptr->type == IdType::kGlobal) {
+      auto symbol = ExternName(id_name, options_);
+      if (options_.pic_mode == PicMode::kNone) {
+        code_.Line("  mov rax, ", symbol);
+      } else if (UsesGot(id_name)) {
+        code_.Line("  mov rax, ", RelOperand{symbol, true});
+      } else {
+        code_.Line("  lea rax, ", RelOperand{symbol});
+      }
+    } else {
+      Error("Undefined symbol: " + id_name);
+    }
+  }
+
+  void Visit(SimpleDeclaration* decl, bool lvalue) {
+    DeclSpecifierVisitor v;
+    for (const auto& spec : decl->specs) {
+      spec->Accept(&v, false);
+    }
+
+    for (const auto& init_decl : decl->dtors) {
+      InitDeclaratorVisitor v2;
+      init_decl->Accept(&v2, false);
+      if (v2.FunctionDeclarator()) {
+        const auto& id_name = v2.Identifier()->value;
+        ids_[id_name].type = IdType::kGlobal;
+        code_.Line("  extern ", ExternName(id_name, options_));
+      } else if (v.IsStatic()) {
+        Error("Static local variable is not supported: " +
+              v2.Identifier()->value);
+      } else if (auto it = locals_.find(v2.Identifier()); it == locals_.end()) {
+        Error("Global variable is not supported: " + v2.Identifier()->value);
+      } else if (auto clause = v2.InitializerClause()) {
+        clause->Accept(this, false);
+        StoreVariable(it->first->value, it->second);
+      }
+    }
+  }
+
+  void Visit(SimpleTypeSpecifier* spec, bool lvalue) {
+  }
+
+  void Visit(InitDeclarator* dtor, bool lvalue) {
+  }
+
+  void Visit(EqualInitializer* init, bool lvalue) {
+  }
+
+  void Visit(InitializerClause* clause, bool lvalue) {
+    if (clause->assign) {
+      clause->assign->Accept(this, lvalue);
+    } else {
+      clause->braced->Accept(this, lvalue);
+    }
+  }
+
+  void Visit(NoPtrDeclarator* dtor, bool lvalue) {
+  }
+
+  void Visit(FunctionDefinition* defn, bool lvalue) {
+    DeclSpecifierVisitor v;
+    for (const auto& spec : defn->specs) {
+      spec->Accept(&v, false);
+    }
+
+    InitDeclaratorVisitor v2;
+    defn->dtor->Accept(&v2, false);
+    if (!v2.Identifier()) {
+      Error("funcname must be specified");
+      return;
+    }
+
+    const auto& id_name = v2.Identifier()->value;
+    auto extern_name = ExternName(id_name, options_);
+    if (plan_.section) {
+      code_.Line("section ", plan_.section, kCodeSectionAttributes);
+    }
+    // ELF symbols get a type and a size, by which profilers attribute samples.
+    if (IsElf(options_)) {
+      code_.Line(v.IsStatic() ? "static " : "global ", extern_name,
+                 ":function (", extern_name, ".end - ", extern_name, ")");
+    } else if (!v.IsStatic()) {
+      code_.Line("global ", extern_name);
+    }
+    code_.Line(extern_name, ":");
+    code_.Line(".start:");
+    counters_symbol_ = kCountersPrefix + id_name;
+    if (plan_.instrument) {
+      IncrementCounter(0);
+    }
+
+    auto body = std::dynamic_pointer_cast<CompoundStatement>(defn->body);
+    if (body->statements.empty()) {
+      code_.Line("  xor rax, rax");
+      code_.Line("  ret");
+      code_.Line(".end:");
+      EndFunction(extern_name, false);
+      return;
+    }
+
+    // Parameters passed in registers stay there unless the body clobbers them
+    // or takes their address.
+    CalleeVisitor clobbers;
+    defn->body->Accept(&clobbers, false);
+    std::vector<const Identifier*> params;
+    FrameLayoutVisitor layout;
+    if (auto func_dtor = v2.FunctionDeclarator()) {
+      for (size_t i = 0; i < func_dtor->param->params.size(); ++i) {
+        const auto& param = func_dtor->param->params[i];
+        DeclSpecifierVisitor param_spec;
+        param->spec->Accept(&param_spec, false);
+        InitDeclaratorVisitor param_dtor;
+        param->dtor->Accept(&param_dtor, false);
+        bool keep_in_register = !clobbers.Calls() &&
+            !(i == kRdxParamIndex && clobbers.Multiplies()) &&
+            !clobbers.Addressed().count(param_dtor.Identifier()->value);
+        layout.DeclareParameter(param_dtor.Identifier(),
+                                param_spec.SimpleTypeSpecifier()->type_info,
+                                i, keep_in_register);
+        params.push_back(param_dtor.Identifier());
+      }
+    }
+    defn->body->Accept(&layout, false);
+
+    ValueNumberingVisitor numbering{layout.Uses(), globals_.pure_functions};
+    defn->body->Accept(&numbering, false);
+    CommonSubexpressionVisitor cse{numbering.Values()};
+    defn->body->Accept(&cse, false);
+    auto reused_values = cse.ReusedValues();
+    std::vector<size_t> temporaries;
+    for (const auto& value : reused_values) {
+      temporaries.push_back(
+          layout.AddTemporary(value.first_point, value.last_use));
+    }
+
+    locals_.clear();
+    size_t stack_size = layout.Layout(locals_);
+
+    saved_values_.clear();
+    for (size_t i = 0; i < reused_values.size(); ++i) {
+      long rbp_offset = layout.RbpOffset(temporaries[i]);
+      saved_values_[reused_values[i].first] = {false, rbp_offset};
+      for (auto reuse : reused_values[i].reuses) {
+        saved_values_[reuse] = {true, rbp_offset};
+      }
+    }
+
+    code_.Line("  push rbp");
+    code_.Line(".frame_pushed:");
+    code_.Line("  mov rbp, rsp");
+    code_.Line(".frame_set:");
+    if (stack_size > 0) {
+      code_.Line("  sub rsp, ", stack_size);
+    }
+    stack_depth_ = 0;
+
+    for (size_t i = 0; i < params.size() && i < kParamRegList.size(); ++i) {
+      const auto& id_info = locals_[params[i]];
+      if (id_info.reg >= 0) {
+        continue;
+      }
+      if (id_info.type_info->size == 1) {
+        code_.Line("  mov byte ", FrameOperand{id_info.rbp_offset}, ", ",
+                   kParamReg8List[i]);
+      } else {
+        code_.Line("  mov dword ", FrameOperand{id_info.rbp_offset}, ", ",
+                   kParamReg32List[i]);
+      }
+    }
+
+    defn->body->Accept(this, false);
+
+    if (stack_size > 0) {
+      code_.Line("  mov rsp, rbp");
+    }
+    code_.Line("  pop rbp");
+    code_.Line(".frame_popped:");
+    code_.Line("  ret");
+    code_.Line(".end:");
+    EndFunction(extern_name, true);
+  }
+
+ private:
+  struct SavedValue {
+    bool reuse;
+    long rbp_offset;
+  };
+
+  // Counts with the index-th counter of the function. The increment is atomic,
+  // so the counts of threads calling the function at once add up.
+  void IncrementCounter(long index) {
+    code_.Line("  lock inc qword ",
+               RelOperand{Symbol{counters_symbol_, false}, false, 8 * index});
+  }
+
+  // Describes the frame of the function symbol in .eh_frame on ELF, so that
+  // profilers, debuggers and exceptions unwind through it. With has_frame, the
+  // CFA is rbp + 16 from the prologue to the epilogue; elsewhere it is rsp + 8.
+  void DescribeFrame(const Symbol& symbol, bool has_frame) {
+    code_.Line(kEhFrameSection);
+    code_.Line("  dd ", has_frame ? 44L : 20L); // length
+    code_.Line("  dd $ - ", kCieSymbol);
+    code_.Line("  dd ", symbol, ".start - $"); // initial location
+    code_.Line("  dd ", symbol, ".end - ", symbol, ".start");
+    code_.Line("  db 0"); // augmentation data length
+    if (has_frame) {
+      code_.Line("  db 0x04"); // DW_CFA_advance_loc4
+      code_.Line("  dd ", symbol, ".frame_pushed - ", symbol, ".start");
+      code_.Line("  db 0x0e, 16"); // DW_CFA_def_cfa_offset 16
+      code_.Line("  db 0x86, 2"); // DW_CFA_offset rbp, CFA - 16
+      code_.Line("  db 0x04");
+      code_.Line("  dd ", symbol, ".frame_set - ", symbol, ".frame_pushed");
+      code_.Line("  db 0x0d, 6"); // DW_CFA_def_cfa_register rbp
+      code_.Line("  db 0x04");
+      code_.Line("  dd ", symbol, ".frame_popped - ", symbol, ".frame_set");
+      code_.Line("  db 0x0c, 7, 8"); // DW_CFA_def_cfa rsp, 8
+    }
+    code_.Line("  db 0, 0, 0, 0, 0, 0, 0"); // DW_CFA_nop up to 8 bytes
+  }
+
+  // Describes the frame and reserves the counters of the function after its
+  // code, and returns to the .text section.
+  void EndFunction(const Symbol& symbol, bool has_frame) {
+    if (IsElf(options_)) {
+      DescribeFrame(symbol, has_frame);
+    }
+    if (plan_.instrument) {
+      code_.Line("section .bss");
+      code_.Line("alignb 8");
+      code_.Line(Symbol{counters_symbol_, false}, ": resq ",
+                 static_cast<long>(plan_.counters.size() + 1));
+    }
+    if (IsElf(options_) || plan_.instrument || plan_.section) {
+      code_.Line("section .text");
+    }
+  }
+
+  void Push(const char* reg) {
+    code_.Line("  push ", reg);
+    ++stack_depth_;
+  }
+
+  void Pop(const char* reg) {
+    code_.Line("  pop ", reg);
+    --stack_depth_;
+  }
+
+  static bool IsVariable(const IdInfo& id_info) {
+    return id_info.type == IdType::kLocalVariable ||
+           id_info.type == IdType::kGlobalVariable;
+  }
+
+  // Loads the value of a variable into eax.
+  void LoadVariable(const std::string& id_name, const IdInfo& id_info) {
+    bool is_char = id_info.type_info->size == 1;
+    if (id_info.type == IdType::kGlobalVariable) {
+      WithGlobalOperand(id_name, [&](const auto& operand) {
+        if (is_char) {
+          code_.Line("  movsx eax, byte ", operand);
+        } else {
+          code_.Line("  mov eax, dword ", operand);
+        }
+      });
+    } else if (id_info.reg >= 0 && is_char) {
+      code_.Line("  movsx eax, ", kParamReg8List[id_info.reg]);
+    } else if (id_info.reg >= 0) {
+      code_.Line("  mov eax, ", kParamReg32List[id_info.reg]);
+    } else if (is_char) {
+      code_.Line("  movsx eax, byte ", FrameOperand{id_info.rbp_offset});
+    } else {
+      code_.Line("  mov eax, dword ", FrameOperand{id_info.rbp_offset});
+    }
+  }
+
+  // Stores eax to a variable.
+  void StoreVariable(const std::string& id_name, const IdInfo& id_info) {
+    bool is_char = id_info.type_info->size == 1;
+    if (id_info.type == IdType::kGlobalVariable) {
+      WithGlobalOperand(id_name, [&](const auto& operand) {
+        code_.Line("  mov ", is_char ? "byte " : "dword ", operand,
+                   is_char ? ", al" : ", eax");
+      });
+    } else if (id_info.reg >= 0 && is_char) {
+      code_.Line("  mov ", kParamReg8List[id_info.reg], ", al");
+    } else if (id_info.reg >= 0) {
+      code_.Line("  mov ", kParamReg32List[id_info.reg], ", eax");
+    } else if (is_char) {
+      code_.Line("  mov byte ", FrameOperand{id_info.rbp_offset}, ", al");
+    } else {
+      code_.Line("  mov dword ", FrameOperand{id_info.rbp_offset}, ", eax");
+    }
+  }
+
+  void LoadAddress(const std::string& id_name, const IdInfo& id_info) {
+    if (id_info.type == IdType::kGlobalVariable) {
+      RelOperand operand{ExternName(id_name, options_), UsesGot(id_name)};
+      code_.Line(operand.got ? "  mov rax, " : "  lea rax, ", operand);
+      return;
+    }
+    if (id_info.reg >= 0) {
+      Error("Cannot take the address of a variable in a register");
+      return;
+    }
+    code_.Line("  lea rax, ", FrameOperand{id_info.rbp_offset});
+  }
+
+  // Returns true if position independent code must refer to a global symbol
+  // through the GOT or the PLT. With -fPIC any symbol with external linkage may
+  // be preempted by another module; with -fPIE only those defined elsewhere.
+  bool UsesGot(const std::string& id_name) const {
+    auto it = globals_.ids.find(id_name);
+    bool defined = it != globals_.ids.end() && it->second.defined;
+    if (defined && it->second.internal) {
+      return false;
+    }
+    return options_.pic_mode == PicMode::kPic ||
+           (options_.pic_mode == PicMode::kPie && !defined);
+  }
+
+  // Calls emit with the memory operand of a global variable. If it is in the
+  // GOT, its address is loaded into r11 first.
+  template <typename Emit>
+  void WithGlobalOperand(const std::string& id_name, Emit emit) {
+    auto symbol = ExternName(id_name, options_);
+    if (UsesGot(id_name)) {
+      code_.Line("  mov r11, ", RelOperand{symbol, true});
+      emit("[r11]");
+    } else {
+      emit(RelOperand{symbol});
+    }
+  }
+
+  // Loads the value of exp and returns true if it has been computed before.
+  bool LoadSavedValue(const Expression* exp) {
+    auto it = saved_values_.find(exp);
+    if (it == saved_values_.end() || !it->second.reuse) {
+      return false;
+    }
+    code_.Line("  mov eax, dword ", FrameOperand{it->second.rbp_offset});
+    return true;
+  }
+
+  // Saves the value of exp if it is going to be reused.
+  void SaveValue(const Expression* exp) {
+    auto it = saved_values_.find(exp);
+    if (it == saved_values_.end() || it->second.reuse) {
+      return;
+    }
+    code_.Line("  mov dword ", FrameOperand{it->second.rbp_offset}, ", eax");
+  }
+
+  const IdInfo* FindId(const Identifier* id) const {
+    if (auto it = locals_.find(id); it != locals_.end()) {
+      return &it->second;
+    }
+    if (auto it = ids_.find(id->value); it != ids_.end()) {
+      return &it->second;
+    }
+    // Identifiers declared after this function are not visible.
+    if (auto it = globals_.ids.find(id->value);
+        it != globals_.ids.end() && it->second.decl_index <= decl_index_) {
+      return &it->second.info;
+    }
+    return nullptr;
+  }
+
+  void Error(const std::string& message) {
+    diagnostics_.push_back({message});
+  }
+
+  CodeBuffer& code_;
+  std::vector<Diagnostic>& diagnostics_;
+  const CompileOptions& options_;
+  const GlobalScope& globals_;
+  size_t decl_index_;
+  const FunctionPlan& plan_;
+  std::string counters_symbol_;
+  std::map<std::string, IdInfo> ids_; // functions declared in the body
+  std::map<const Identifier*, IdInfo> locals_; // references to local variables
+  std::map<const Expression*, SavedValue> saved_values_;
+  size_t stack_depth_ = 0; // 8-byte words pushed since the prologue
+};
+
+// Collects the identifiers declared at namespace scope, and generates the
+// code for declarations other than function definitions.
+class DeclarationCollectVisitor : public BaseVisitor {
+ public:
+  DeclarationCollectVisitor(std::vector<CodeBuffer>& decl_code,
+                            std::vector<Diagnostic>& diagnostics,
+                            const CompileOptions& options, GlobalScope& globals)
+      : decl_code_{decl_code}, diagnostics_{diagnostics}, options_{options},
+        globals_{globals} {
+  }
+
+  // Variables are defined after all declarations are collected, as their
+  // initializers may call any pure function declared before them.
+  void Visit(TranslationUnit* unit, bool lvalue) {
+    std::set<std::string> variables;
+    for (decl_index_ = 0; decl_index_ < unit->decls.size(); ++decl_index_) {
+      unit->decls[decl_index_]->Accept(this, lvalue);
+    }
+    for (const auto& [id_name, id] : globals_.ids) {
+      if (id.info.type == IdType::kGlobalVariable) {
+        variables.insert(id_name);
+      }
+    }
+    globals_.pure_functions = FindPureFunctions(unit, variables);
+
+    Interpreter interpreter{*unit, globals_};
+    for (const auto& var : variables_) {
+      DefineVariable(var, interpreter);
+    }
+  }
+
+  void Visit(SimpleDeclaration* decl, bool lvalue) {
+    DeclSpecifierVisitor v;
+    for (const auto& spec : decl->specs) {
+      spec->Accept(&v, false);
+    }
+
+    for (const auto& init_decl : decl->dtors) {
+      InitDeclaratorVisitor v2;
+      init_decl->Accept(&v2, false);
+      const auto& id_name = v2.Identifier()->value;
+      if (v2.FunctionDeclarator()) {
+        Declare(id_name, {IdType::kGlobal, 0, nullptr, -1}, false, v.IsStatic());
+        if (!v.IsStatic()) {
+          decl_code_[decl_index_].Line("  extern ",
+                                       ExternName(id_name, options_));
+        }
+      } else {
+        auto type_info = v.SimpleTypeSpecifier()->type_info;
+        Declare(id_name, {IdType::kGlobalVariable, 0, type_info, -1}, true,
+                v.IsStatic());
+        variables_.push_back(
+            {id_name, type_info, v2.InitializerClause(), decl_index_});
+      }
+    }
+  }
+
+  void Visit(FunctionDefinition* defn, bool lvalue) {
+    DeclSpecifierVisitor v;
+    for (const auto& spec : defn->specs) {
+      spec->Accept(&v, false);
+    }
+    InitDeclaratorVisitor v2;
+    defn->dtor->Accept(&v2, false);
+    if (v2.Identifier()) {
+      Declare(v2.Identifier()->value, {IdType::kGlobal, 0, nullptr, -1}, true,
+              v.IsStatic());
+    }
+  }
+
+ private:
+  // Functions may be declared more than once, variables may not.
+  // A function keeps internal linkage if any declaration is static.
+  void Declare(const std::string& id_name, const IdInfo& info, bool defined,
+               bool internal) {
+    auto [it, inserted] =
+        globals_.ids.insert({id_name, {info, decl_index_, defined, internal}});
+    if (!inserted && (info.type == IdType::kGlobalVariable ||
+                      it->second.info.type == IdType::kGlobalVariable)) {
+      diagnostics_.push_back({"Redefinition of " + id_name});
+    }
+    it->second.defined = it->second.defined || defined;
+    it->second.internal = it->second.internal || internal;
+  }
+
+  struct Variable {
+    std::string id_name;
+    const TypeInfo* type_info;
+    const InitializerClause* init;
+    size_t decl_index;
+  };
+
+  // Emits a variable into .data if it has a non-zero initial value, or into
+  // .bss. The initializer must be a constant expression, so that the variable
+  // needs no code to initialize it.
+  void DefineVariable(const Variable& var, Interpreter& interpreter) {
+    const auto& id_name = var.id_name;
+    int32_t value = 0;
+    if (var.init &&
+        !interpreter.Evaluate(var.init->assign.get(), var.decl_index, value)) {
+      diagnostics_.push_back(
+          {"Initializer of " + id_name + " is not a constant expression"});
+      return;
+    }
+
+    auto& code = decl_code_[var.decl_index];
+    auto symbol = ExternName(id_name, options_);
+    bool is_char = var.type_info->size == 1;
+    if (is_char) {
+      value = static_cast<int8_t>(value);
+    }
+    if (!globals_.ids.at(id_name).internal) {
+      code.Line("global ", symbol);
+    }
+    auto align = static_cast<long>(var.type_info->align);
+    if (value != 0) {
+      code.Line("section .data");
+      code.Line("  align ", align);
+      code.Line(symbol, is_char ? ": db " : ": dd ", static_cast<long>(value));
+    } else {
+      code.Line("section .bss");
+      code.Line("  alignb ", align);
+      code.Line(symbol, is_char ? ": resb 1" : ": resd 1");
+    }
+    code.Line("section .text");
+  }
+
+  std::vector<CodeBuffer>& decl_code_;
+  std::vector<Diagnostic>& diagnostics_;
+  const CompileOptions& options_;
+  GlobalScope& globals_;
+  size_t decl_index_ = 0;
+  std::vector<Variable> variables_;
+};
+
+void AddToken(Hasher& hasher, const Token& token) {
+  hasher.Add(std::to_string(static_cast<int>(token.type)) + ' ' +
+             std::to_string(token.int_value) + ' ' + token.string_value);
+}
+
+// Returns the key of the code generated for a function definition, the
+// decl_index-th declaration. The code depends only on the options, the tokens
+// of the definition and of the definitions inlined into it, what the
+// identifiers in them refer to outside, and the parameters replaced by
+// constants.
+std::string FunctionKey(const std::vector<Token>& tokens,
+                        const TranslationUnit& unit, size_t decl_index,
+                        const std::set<size_t>& inlined,
+                        const GlobalScope& globals,
+                        const std::string& options_key,
+                        const InterproceduralOptimizer& optimizer) {
+  Hasher hasher;
+  hasher.Add(options_key);
+  auto add_definition = [&](size_t index) {
+    for (const auto& [id_name, value] : optimizer.ConstantParams(index)) {
+      hasher.Add("constant " + id_name + ' ' + std::to_string(value));
+    }
+    const auto& decl = *unit.decls[index];
+    for (size_t i = decl.token_begin; i < decl.token_end; ++i) {
+      const auto& token = tokens[i];
+      AddToken(hasher, token);
+      if (token.type != TokenType::kId) {
+        continue;
+      }
+      if (auto it = globals.ids.find(token.string_value);
+          it != globals.ids.end() && it->second.decl_index <= index) {
+        const auto& info = it->second.info;
+        hasher.Add(it->second.internal ? "internal" : "external");
+        if (info.type == IdType::kGlobalVariable) {
+          hasher.Add("variable " + std::to_string(info.type_info->size));
+        } else {
+          hasher.Add(globals.pure_functions.count(token.string_value) ?
+                     "pure" : "global");
+          hasher.Add(it->second.defined ? "defined" : "extern");
+          // Calls of pure functions may be folded with their definitions.
+          if (globals.pure_functions.count(token.string_value)) {
+            hasher.Add(globals.pure_digest);
+          }
+        }
+      } else {
+        hasher.Add("undeclared");
+      }
+    }
+  };
+  add_definition(decl_index);
+  for (auto index : inlined) {
+    hasher.Add("inlined");
+    add_definition(index);
+  }
+  return hasher.HexDigest();
+}
+
+// Returns the hash of the tokens of the pure function definitions.
+std::string PureDigest(const TranslationUnit& unit,
+                       const std::vector<Token>& tokens,
+                       const GlobalScope& globals) {
+  Hasher hasher;
+  for (const auto& decl : unit.decls) {
+    InitDeclaratorVisitor v;
+    if (auto defn = std::dynamic_pointer_cast<FunctionDefinition>(decl)) {
+      defn->dtor->Accept(&v, false);
+    }
+    if (!v.Identifier() || !globals.pure_functions.count(v.Identifier()->value)) {
+      continue;
+    }
+    for (size_t i = decl->token_begin; i < decl->token_end; ++i) {
+      AddToken(hasher, tokens[i]);
+    }
+  }
+  return hasher.HexDigest();
+}
+
+class CodeGenerator {
+ public:
+  CodeGenerator(const CompileOptions& options) : options_{options} {
+  }
+
+  // Collects declarations serially, then generates code for the function
+  // definitions in parallel on options.num_jobs threads, and writes the code to
+  // out in the order of the declarations.
+  //
+  // The declarations are generated in windows of a few per thread. Each window
+  // is written to out as soon as it is done and its buffers are freed, so the
+  // memory for code does not grow with the size of the translation unit.
+  //
+  // With fn_cache, the code of a function definition is taken from it if the
+  // definition is unchanged, and the generated code is added to it.
+  //
+  // With options.profile_use, the functions are placed and the hot calls are
+  // inlined by the profile after the other optimizations. With
+  // options.profile_generate, the counters are added to the code as it is
+  // finally generated, and their table is written last.
+  //
+  // Returns false if there are errors, which are left in Diagnostics(). The
+  // code written before an error was found is left in out.
+  bool Generate(std::shared_ptr<ASTNode> ast_root,
+                const std::vector<Token>& tokens, FunctionCache* fn_cache,
+                std::ostream& out) {
+    auto unit = std::dynamic_pointer_cast<TranslationUnit>(ast_root);
+    const auto& decls = unit->decls;
+    Profile profile;
+    if (!options_.profile_use.empty() && !profile.Read(options_.profile_use)) {
+      diagnostics_.push_back({"Cannot read the profile " +
+                              options_.profile_use});
+      return false;
+    }
+    std::vector<CodeBuffer> decl_code(decls.size());
+    std::vector<std::vector<Diagnostic>> decl_diagnostics(decls.size());
+    GlobalScope globals;
+    DeclarationCollectVisitor collector{decl_code, diagnostics_, options_,
+                                        globals};
+    unit->Accept(&collector, false);
+    if (fn_cache) {
+      globals.pure_digest = PureDigest(*unit, tokens, globals);
+    }
+
+    // Folding rewrites function bodies which the interpreter reads, so it runs
+    // serially, before any code is generated in parallel.
+    Interpreter interpreter{*unit, globals};
+    for (size_t i = 0; i < decls.size(); ++i) {
+      if (auto defn = std::dynamic_pointer_cast<FunctionDefinition>(decls[i])) {
+        ConstantFolder folder{interpreter, i};
+        folder.Fold(defn.get());
+      }
+    }
+    InterproceduralOptimizer optimizer{*unit, globals, interpreter};
+    optimizer.Run();
+
+    std::vector<FunctionPlan> plans(decls.size());
+    if (!options_.profile_use.empty()) {
+      UseProfile(*unit, globals, profile, interpreter, optimizer, plans);
+    }
+    if (options_.profile_generate) {
+      for (size_t i = 0; i < decls.size(); ++i) {
+        if (std::dynamic_pointer_cast<FunctionDefinition>(decls[i]) &&
+            optimizer.IsLive(i)) {
+          plans[i].instrument = true;
+          CallSiteVisitor sites;
+          decls[i]->Accept(&sites, false);
+          for (size_t k = 0; k < sites.Calls().size(); ++k) {
+            plans[i].counters[sites.Calls()[k].exp] = k + 1;
+          }
+        }
+      }
+    }
+    std::string options_key;
+    if (fn_cache) {
+      options_key = CompileOptionsKey(options_);
+    }
+    if (IsElf(options_) && diagnostics_.empty()) {
+      Write(CommonInformationEntry(), out);
+    }
+
+    ThreadPool pool{options_.num_jobs};
+    const size_t window = kDeclsPerJob * options_.num_jobs;
+    for (size_t begin = 0, end; begin < decls.size(); begin = end) {
+      end = std::min(begin + window, decls.size());
+      std::vector<std::string> keys(end - begin);
+      for (size_t i = begin; i < end; ++i) {
+        if (!std::dynamic_pointer_cast<FunctionDefinition>(decls[i]) ||
+            !optimizer.IsLive(i)) {
+          continue;
+        }
+        if (fn_cache) {
+          auto& key = keys[i - begin];
+          key = FunctionKey(tokens, *unit, i, plans[i].inlined, globals,
+                            options_key, optimizer);
+          std::string code;
+          if (fn_cache->Find(key, code)) {
+            decl_code[i].Append(code);
+            key.clear();
+            continue;
+          }
+        }
+        pool.Submit([&, i] {
+          CodeGenerateVisitor visitor{decl_code[i], decl_diagnostics[i],
+                                      options_, globals, i, plans[i]};
+          decls[i]->Accept(&visitor, false);
+        });
+      }
+      pool.Wait();
+
+      for (size_t i = begin; i < end; ++i) {
+        diagnostics_.insert(diagnostics_.end(), decl_diagnostics[i].begin(),
+                            decl_diagnostics[i].end());
+        const auto& key = keys[i - begin];
+        if (fn_cache && !key.empty() && decl_diagnostics[i].empty()) {
+          fn_cache->Add(key, decl_code[i].Text());
+        }
+        if (diagnostics_.empty()) {
+          Write(decl_code[i], out);
+        }
+        decl_code[i] = CodeBuffer{};
+      }
+    }
+    if (options_.profile_generate && diagnostics_.empty()) {
+      Write(CounterTable(*unit, plans), out);
+    }
+    return diagnostics_.empty();
+  }
+
+  const std::vector<Diagnostic>& Diagnostics() const {
+    return diagnostics_;
+  }
+
+  size_t NumLines() const {
+    return num_lines_;
+  }
+
+  // Seconds spent writing to out, included in the time of Generate().
+  double WriteSeconds() const {
+    return write_seconds_;
+  }
+
+ private:
+  static const size_t kDeclsPerJob = 16;
+
+  // Places the live functions which the profile finds hot, or never called, in
+  // sections of their own, so that the code run most shares the fewest pages,
+  // and inlines the hot calls. The section names are those which the ELF
+  // linkers group.
+  void UseProfile(const TranslationUnit& unit, const GlobalScope& globals,
+                  const Profile& profile, Interpreter& interpreter,
+                  InterproceduralOptimizer& optimizer,
+                  std::vector<FunctionPlan>& plans) {
+    Inliner inliner{unit, globals};
+    bool inlined = false;
+    for (size_t i = 0; i < unit.decls.size(); ++i) {
+      auto defn = std::dynamic_pointer_cast<FunctionDefinition>(unit.decls[i]);
+      if (!defn || !optimizer.IsLive(i)) {
+        continue;
+      }
+      InitDeclaratorVisitor v;
+      defn->dtor->Accept(&v, false);
+      const auto& id_name = v.Identifier()->value;
+      auto count = profile.EntryCount(id_name);
+      if (count && IsElf(options_)) {
+        plans[i].section = profile.IsHot(*count) ? ".text.hot" :
+                           *count == 0 ? ".text.unlikely" : nullptr;
+      }
+
+      // The call sites are numbered as in the build which wrote the profile,
+      // before any inlining.
+      CallSiteVisitor sites;
+      defn->body->Accept(&sites, false);
+      std::set<const FunctionCallExpression*> hot_calls;
+      for (size_t k = 0; k < sites.Calls().size(); ++k) {
+        if (profile.IsHot(profile.SiteCount(id_name, k))) {
+          hot_calls.insert(sites.Calls()[k].exp);
+        }
+      }
+      if (!hot_calls.empty() &&
+          inliner.Inline(defn.get(), i, hot_calls, plans[i].inlined)) {
+        for (auto callee : std::set<size_t>{plans[i].inlined}) {
+          plans[i].inlined.insert(plans[callee].inlined.begin(),
+                                  plans[callee].inlined.end());
+        }
+        ConstantFolder folder{interpreter, i};
+        folder.Fold(defn.get(), optimizer.ConstantParams(i));
+        optimizer.Rescan(i);
+        inlined = true;
+      }
+    }
+    // Functions whose calls are all inlined may be dead now, and arguments
+    // may have become constant.
+    if (inlined) {
+      optimizer.Run();
+    }
+  }
+
+  // Returns the entry of .eh_frame which the frame descriptions of the
+  // functions refer to. Mach-O has unwind information of its own.
+  static CodeBuffer CommonInformationEntry() {
+    CodeBuffer code;
+    code.Line(kEhFrameSection);
+    code.Line(kCieSymbol, ":");
+    code.Line("  dd 20"); // length
+    code.Line("  dd 0"); // CIE id
+    code.Line("  db 1"); // version
+    code.Line("  db \"zR\", 0"); // augmentation
+    code.Line("  db 1"); // code alignment factor
+    code.Line("  db 0x78"); // data alignment factor, -8
+    code.Line("  db 16"); // return address register, rip
+    code.Line("  db 1"); // augmentation data length
+    code.Line("  db 0x1b"); // FDE pointers are pc-relative sdata4
+    code.Line("  db 0x0c, 7, 8"); // DW_CFA_def_cfa rsp, 8
+    code.Line("  db 0x90, 1"); // DW_CFA_offset rip, CFA - 8
+    code.Line("  db 0, 0"); // DW_CFA_nop up to 8 bytes
+    code.Line("section .text");
+    return code;
+  }
+
+  // Returns the table of the counters of the instrumented functions, and the
+  // code registering it with the runtime as the program starts: the number of
+  // functions, then the name, the counters and the number of counters of each.
+  CodeBuffer CounterTable(const TranslationUnit& unit,
+                          const std::vector<FunctionPlan>& plans) const {
+    std::vector<std::pair<std::string, long>> functions;
+    for (size_t i = 0; i < plans.size(); ++i) {
+      if (!plans[i].instrument) {
+        continue;
+      }
+      InitDeclaratorVisitor v;
+      auto defn = std::dynamic_pointer_cast<FunctionDefinition>(unit.decls[i]);
+      defn->dtor->Accept(&v, false);
+      functions.emplace_back(v.Identifier()->value,
+                             static_cast<long>(plans[i].counters.size() + 1));
+    }
+
+    CodeBuffer code;
+    code.Line("section .rodata");
+    for (size_t i = 0; i < functions.size(); ++i) {
+      code.Line(kCountersPrefix, "name_", static_cast<long>(i), ": db \"",
+                functions[i].first, "\", 0");
+    }
+    code.Line("section .data");
+    code.Line("align 8");
+    code.Line(kCountersPrefix, "table:");
+    code.Line("  dq ", static_cast<long>(functions.size()));
+    for (size_t i = 0; i < functions.size(); ++i) {
+      code.Line("  dq ", kCountersPrefix, "name_", static_cast<long>(i), ", ",
+                kCountersPrefix, functions[i].first, ", ",
+                functions[i].second);
+    }
+
+    auto register_symbol = ExternName(kProfileRegister, options_);
+    if (IsElf(options_)) {
+      code.Line("section .init_array");
+    } else {
+      code.Line("section __DATA,__mod_init_func");
+    }
+    code.Line("align 8");
+    code.Line("  dq ", kCountersPrefix, "init");
+    code.Line("section .text");
+    code.Line("extern ", register_symbol);
+    code.Line(kCountersPrefix, "init:");
+    code.Line("  lea rdi, [rel ", kCountersPrefix, "table]");
+    if (options_.pic_mode != PicMode::kNone && IsElf(options_)) {
+      code.Line("  jmp ", register_symbol, " wrt ..plt");
+    } else {
+      code.Line("  jmp ", register_symbol);
+    }
+    return code;
+  }
+
+  void Write(const CodeBuffer& code, std::ostream& out) {
+    auto start = std::chrono::steady_clock::now();
+    out.write(code.Text().data(), code.Text().size());
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    write_seconds_ += elapsed.count();
+    num_lines_ += code.NumLines();
+  }
+
+  const CompileOptions& options_;
+  std::vector<Diagnostic> diagnostics_;
+  size_t num_lines_ = 0;
+  double write_seconds_ = 0;
+};
+
+Compiler::Compiler(const CompileOptions& options) : options_{options} {
+}
+
+bool Compiler::Compile(std::string_view src, std::ostream& out) {
+  diagnostics_.clear();
+  stats_ = {};
+  std::vector<Token> tokens;
+  auto ast = ParseSource(src, tokens);
+  if (!ast) {
+    return false;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  CodeGenerator generator{options_};
+  bool generated = generator.Generate(ast, tokens, fn_cache_, out);
+  out.flush();
+  std::chrono::duration<double> generate_seconds =
+      std::chrono::steady_clock::now() - start;
+  stats_.emit_seconds = generator.WriteSeconds();
+  stats_.codegen_seconds = generate_seconds.count() - stats_.emit_seconds;
+  stats_.num_lines = generator.NumLines();
+  if (!generated) {
+    diagnostics_ = generator.Diagnostics();
+    return false;
+  }
+  return true;
+}
+
+bool Compiler::EmitAst(std::string_view src, std::ostream& out) {
+  diagnostics_.clear();
+  stats_ = {};
+  std::vector<Token> tokens;
+  auto ast = ParseSource(src, tokens);
+  if (!ast) {
+    return false;
+  }
+  WriteAstFile(*std::dynamic_pointer_cast<TranslationUnit>(ast), out);
+  out.flush();
+  return true;
+}
+
+std::shared_ptr<ASTNode> Compiler::ParseSource(std::string_view src,
+                                               std::vector<Token>& tokens) {
+  auto start = std::chrono::steady_clock::now();
+  // Returns the seconds since the previous call.
+  auto lap = [&start] {
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = now - start;
+    start = now;
+    return elapsed.count();
+  };
+
+  // The tokenizer reads up to a null character.
+  std::string text{src};
+  SourceReader src_reader{text.c_str()};
+
+  auto result = Tokenize(src_reader, tokens);
+  stats_.tokenize_seconds = lap();
+  stats_.num_tokens = tokens.size();
+  if (!result.success) {
+    auto offset = tokens.back().offset;
+    diagnostics_.push_back(
+        {"Unknown character '" + text.substr(offset, 1) + "'", offset});
+    return nullptr;
+  }
+
+  TokenReader token_reader{tokens};
+
+  std::vector<SyntaxError> errors;
+  auto ast = Parse(token_reader, &stats_.num_nodes, &errors);
+  stats_.parse_seconds = lap();
+  for (const auto& error : errors) {
+    diagnostics_.push_back({error.message, tokens[error.token].offset});
+  }
+  if (!ast && errors.empty()) {
+    diagnostics_.push_back({"Parse error"});
+  }
+  return ast;
+}
+
+namespace {
+
+// Writes the diagnostics one per line, those with an offset in src prefixed
+// with its line and column, counted from 1.
+void WriteDiagnostics(const std::vector<Diagnostic>& diagnostics,
+                      std::string_view src, std::ostream& err) {
+  size_t line = 1, line_begin = 0, scanned = 0;
+  for (const auto& diagnostic : diagnostics) {
+    if (diagnostic.offset == kNoSourceOffset) {
+      err << diagnostic.message << std::endl;
+      continue;
+    }
+    // Diagnostics with offsets come in source order, so src is scanned once.
+    auto offset = std::min(diagnostic.offset, src.size());
+    if (offset < scanned) {
+      line = 1, line_begin = 0, scanned = 0;
+    }
+    for (; scanned < offset; ++scanned) {
+      if (src[scanned] == '\n') {
+        ++line;
+        line_begin = scanned + 1;
+      }
+    }
+    err << line << ':' << offset - line_begin + 1 << ": "
+        << diagnostic.message << std::endl;
+  }
+}
+
+} // namespace
+
+int Compile(const std::string& src, std::ostream& out, std::ostream& err,
+            const CompileOptions& options, FunctionCache* fn_cache,
+            CompileStats* stats) {
+  Compiler compiler{options};
+  compiler.SetFunctionCache(fn_cache);
+  bool success = compiler.Compile(src, out);
+  WriteDiagnostics(compiler.Diagnostics(), src, err);
+  if (stats) {
+    *stats = compiler.Stats();
+  }
+  return success ? 0 : -1;
+}
+
+int EmitAst(const std::string& src, std::ostream& out, std::ostream& err) {
+  Compiler compiler;
+  bool success = compiler.EmitAst(src, out);
+  WriteDiagnostics(compiler.Diagnostics(), src, err);
+  return success ? 0 : -1;
+}
+
+void WriteStatsJson(const CompileStats& stats, std::ostream& out) {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  auto rate = [](size_t count, double seconds) {
+    return seconds > 0 ? count / seconds : 0;
+  };
+  out << "{\"tokens\": " << stats.num_tokens
+      << ", \"nodes\": " << stats.num_nodes
+      << ", \"lines\": " << stats.num_lines
+      << ", \"tokenize_seconds\": " << stats.tokenize_seconds
+      << ", \"parse_seconds\": " << stats.parse_seconds
+      << ", \"codegen_seconds\": " << stats.codegen_seconds
+      << ", \"emit_seconds\": " << stats.emit_seconds
+      << ", \"tokens_per_second\": "
+      << rate(stats.num_tokens, stats.tokenize_seconds)
+      << ", \"nodes_per_second\": "
+      << rate(stats.num_nodes, stats.parse_seconds)
+      << ", \"lines_per_second\": "
+      << rate(stats.num_lines, stats.codegen_seconds + stats.emit_seconds)
+      // ru_maxrss is in kilobytes on Linux, and in bytes on macOS.
+#ifdef __APPLE__
+      << ", \"peak_rss_kb\": " << usage.ru_maxrss / 1024 << "}";
+#else
+      << ", \"peak_rss_kb\": " << usage.ru_maxrss << "}";
+#endif
+}
+
+// The Makefile defines NINECXX_SOURCE_HASH as a hash of all the sources of
+// 9cxx, which tells builds apart better than a version number or a build time.
+#ifndef NINECXX_SOURCE_HASH
+#error "NINECXX_SOURCE_HASH must be defined as a hash of the sources"
+#endif
+
+std::string CompileOptionsKey(const CompileOptions& options) {
+  // num_jobs is left out as it does not change the output.
+  const char* pic_flag = options.pic_mode == PicMode::kPie ? " -fPIE" :
+                         options.pic_mode == PicMode::kPic ? " -fPIC" : "";
+  auto key = std::string{"9cxx " NINECXX_SOURCE_HASH} +
+             (IsElf(options) ? " -fobject-format=elf64" :
+                               " -fobject-format=macho64") +
+             (options.leading_underscore ? "" : " -fno-leading-underscore") +
+             pic_flag;
+  if (options.profile_generate) {
+    key += " -fprofile-generate";
+  }
+  // The code depends on the counts in the profile, not on where it is. A
+  // profile which cannot be read makes the compilation fail instead.
+  if (!options.profile_use.empty()) {
+    std::ifstream in{options.profile_use};
+    Hasher hasher;
+    hasher.Add(std::string{std::istreambuf_iterator<char>{in}, {}});
+    key += " -fprofile-use=" + (in.is_open() ? hasher.HexDigest() : "-");
+  }
+  return key;
+}
+
+size_t ParseCompileOption(const std::vector<std::string>& args, size_t i,
+                          CompileOptions& options) {
+  const auto& arg = args[i];
+  if (arg == "-fobject-format=elf64") {
+    options.object_format = ObjectFormat::kElf64;
+    return 1;
+  } else if (arg == "-fobject-format=macho64") {
+    options.object_format = ObjectFormat::kMachO64;
+    return 1;
+  } else if (arg == "-fno-leading-underscore") {
+    options.leading_underscore = false;
+    return 1;
+  } else if (arg == "-fPIE" || arg == "-fpie") {
+    options.pic_mode = PicMode::kPie;
+    return 1;
+  } else if (arg == "-fPIC" || arg == "-fpic") {
+    options.pic_mode = PicMode::kPic;
+    return 1;
+  } else if (arg == "-fno-pie" || arg == "-fno-pic") {
+    options.pic_mode = PicMode::kNone;
+    return 1;
+  } else if (arg == "-fprofile-generate") {
+    options.profile_generate = true;
+    return 1;
+  } else if (arg.compare(0, 14, "-fprofile-use=") == 0 && arg.size() > 14) {
+    options.profile_use = arg.substr(14);
+    return 1;
+  } else if (arg == "-j" && i + 1 < args.size()) {
+    options.num_jobs = std::max(atoi(args[i + 1].c_str()), 1);
+    return 2;
+  } else if (arg.compare(0, 2, "-j") == 0 && arg.size() > 2) {
+    options.num_jobs = std::max(atoi(arg.c_str() + 2), 1);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// How the generated code refers to symbols.
+enum class PicMode {
+  kNone, // absolute addresses may be used
+  kPie,  // -fPIE: position independent, symbols defined here are not preempted
+  kPic,  // -fPIC: position independent, for shared libraries
+};
+
+// The object file format which the assembly is written for, as NASM's -f names
+// it.
+enum class ObjectFormat {
+  kElf64,   // -fobject-format=elf64
+  kMachO64, // -fobject-format=macho64
+};
+
+#ifdef __APPLE__
+const ObjectFormat kHostObjectFormat = ObjectFormat::kMachO64;
+#else
+const ObjectFormat kHostObjectFormat = ObjectFormat::kElf64;
+#endif
+
+struct CompileOptions {
+  ObjectFormat object_format = kHostObjectFormat;
+  bool leading_underscore = true;
+  PicMode pic_mode = PicMode::kNone;
+  size_t num_jobs = 1; // threads generating code for function definitions
+  // -fprofile-generate: count the calls of functions and call sites, for the
+  // runtime in runtime/profile.cpp to write to a profile.
+  bool profile_generate = false;
+  // -fprofile-use=FILE: the profile to place functions and inline hot calls
+  // by, or empty.
+  std::string profile_use;
+};
+
+// Sizes and phase times of a compilation.
+struct CompileStats {
+  size_t num_tokens = 0;
+  size_t num_nodes = 0; // AST nodes
+  size_t num_lines = 0; // lines of assembly
+  double tokenize_seconds = 0;
+  double parse_seconds = 0;
+  double codegen_seconds = 0;
+  double emit_seconds = 0;
+};
+
+const size_t kNoSourceOffset = SIZE_MAX;
+
+struct Diagnostic {
+  std::string message;
+  // The offset in the source which the diagnostic is about, if known.
+  size_t offset = kNoSourceOffset;
+};
+
+class FunctionCache;
+struct ASTNode;
+struct Token;
+
+// Compiles translation units with a fixed set of options. Instances share no
+// state, so separate instances can compile on separate threads.
+class Compiler {
+ public:
+  explicit Compiler(const CompileOptions& options = {});
+
+  // Compiles src and writes the assembly to out, one function at a time.
+  // Returns false on an error, in which case the output is incomplete and
+  // Diagnostics() tells why.
+  bool Compile(std::string_view src, std::ostream& out);
+
+  // Parses src and writes its AST to out in the format of ast_file.hpp.
+  // Returns false on an error, which Diagnostics() tells.
+  bool EmitAst(std::string_view src, std::ostream& out);
+
+  // If set, function definitions found in fn_cache are not generated again,
+  // and it receives the code of the others.
+  void SetFunctionCache(FunctionCache* fn_cache) { fn_cache_ = fn_cache; }
+
+  const CompileOptions& Options() const { return options_; }
+
+  // The results of the last Compile().
+  const std::vector<Diagnostic>& Diagnostics() const { return diagnostics_; }
+  const CompileStats& Stats() const { return stats_; }
+
+ private:
+  // Tokenizes src into tokens and parses them. Returns null on an error.
+  std::shared_ptr<ASTNode> ParseSource(std::string_view src,
+                                       std::vector<Token>& tokens);
+
+  CompileOptions options_;
+  FunctionCache* fn_cache_ = nullptr;
+  std::vector<Diagnostic> diagnostics_;
+  CompileStats stats_;
+};
+
+// Compiles a translation unit and writes the assembly to out. Diagnostics go to
+// err, those with an offset prefixed by its line and column. Returns 0 on
+// success. If fn_cache is given, function definitions found
+// in it are not generated again, and it receives the code of the others. If
+// stats is given, it receives the measurements of the phases which ran.
+int Compile(const std::string& src, std::ostream& out, std::ostream& err,
+            const CompileOptions& options, FunctionCache* fn_cache = nullptr,
+            CompileStats* stats = nullptr);
+
+// Parses src and writes its AST to out in the format of ast_file.hpp.
+// Diagnostics go to err. Returns 0 on success.
+int EmitAst(const std::string& src, std::ostream& out, std::ostream& err);
+
+// Writes stats as a JSON object, adding the peak resident set size of this
+// process.
+void WriteStatsJson(const CompileStats& stats, std::ostream& out);
+
+// Returns a string identifying the compiler build and the options which
+// affect the generated code, so equal keys mean equal output for equal source.
+std::string CompileOptionsKey(const CompileOptions& options);
+
+// Parses the compile option at args[i] into options. Returns the number of
+// arguments consumed, or 0 if args[i] is not a compile option.
+size_t ParseCompileOption(const std::vector<std::string>& args, size_t i,
+                          CompileOptions& options);
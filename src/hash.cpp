@@ -0,0 +1,86 @@
+#include "hash.hpp"
+
+#include <cstdio>
+
+namespace {
+
+uint32_t RotateLeft(uint32_t x, int n) {
+  return (x << n) | (x >> (32 - n));
+}
+
+} // namespace
+
+void Hasher::Add(const void* data, size_t size) {
+  auto bytes = static_cast<const unsigned char*>(data);
+  total_bytes_ += size;
+  for (size_t i = 0; i < size; ++i) {
+    block_[block_size_++] = bytes[i];
+    if (block_size_ == block_.size()) {
+      ProcessBlock();
+    }
+  }
+}
+
+std::string Hasher::HexDigest() {
+  // The message is padded with a 1 bit and zeros up to 8 bytes before the end
+  // of a block, which get its length in bits, big-endian.
+  uint64_t total_bits = total_bytes_ * 8;
+  const unsigned char kOne = 0x80, kZero = 0;
+  Add(&kOne, 1);
+  while (block_size_ != block_.size() - 8) {
+    Add(&kZero, 1);
+  }
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    unsigned char byte = total_bits >> shift;
+    Add(&byte, 1);
+  }
+
+  std::string hex;
+  for (auto word : state_) {
+    char buf[9];
+    snprintf(buf, sizeof(buf), "%08x", static_cast<unsigned>(word));
+    hex += buf;
+  }
+  return hex;
+}
+
+void Hasher::ProcessBlock() {
+  uint32_t w[80];
+  for (int t = 0; t < 16; ++t) {
+    w[t] = uint32_t{block_[4 * t]} << 24 | uint32_t{block_[4 * t + 1]} << 16 |
+           uint32_t{block_[4 * t + 2]} << 8 | block_[4 * t + 3];
+  }
+  for (int t = 16; t < 80; ++t) {
+    w[t] = RotateLeft(w[t - 3] ^ w[t - 8] ^ w[t - 14] ^ w[t - 16], 1);
+  }
+
+  auto [a, b, c, d, e] = state_;
+  for (int t = 0; t < 80; ++t) {
+    uint32_t f, k;
+    if (t < 20) {
+      f = (b & c) | (~b & d);
+      k = 0x5a827999;
+    } else if (t < 40) {
+      f = b ^ c ^ d;
+      k = 0x6ed9eba1;
+    } else if (t < 60) {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8f1bbcdc;
+    } else {
+      f = b ^ c ^ d;
+      k = 0xca62c1d6;
+    }
+    uint32_t temp = RotateLeft(a, 5) + f + e + k + w[t];
+    e = d;
+    d = c;
+    c = RotateLeft(b, 30);
+    b = a;
+    a = temp;
+  }
+  state_[0] += a;
+  state_[1] += b;
+  state_[2] += c;
+  state_[3] += d;
+  state_[4] += e;
+  block_size_ = 0;
+}
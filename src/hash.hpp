@@ -0,0 +1,32 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Computes the SHA-1 digest of the bytes added to it.
+class Hasher {
+ public:
+  void Add(const void* data, size_t size);
+
+  // Adds s with its terminating null, so that consecutive strings are
+  // delimited.
+  void Add(const std::string& s) {
+    Add(s.c_str(), s.size() + 1);
+  }
+
+  // Returns the digest in hex, in the byte order of FIPS 180-4, as sha1sum
+  // prints it. Nothing may be added afterwards.
+  std::string HexDigest();
+
+ private:
+  // Processes the 64-byte block in block_.
+  void ProcessBlock();
+
+  std::array<uint32_t, 5> state_{
+      0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+  std::array<unsigned char, 64> block_;
+  size_t block_size_ = 0;
+  uint64_t total_bytes_ = 0;
+};
@@ -0,0 +1,648 @@
+#include "lsp.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "tokenizer.hpp"
+#include "parser.hpp"
+#include "ast.hpp"
+
+namespace {
+
+const size_t kMaxJsonDepth = 256;
+
+// The error codes of JSON-RPC.
+const int kParseError = -32700;
+const int kInvalidRequest = -32600;
+const int kMethodNotFound = -32601;
+
+// A JSON value, as much of one as the protocol needs.
+struct Json {
+  enum class Type { kNull, kBool, kNumber, kString, kArray, kObject };
+
+  Type type = Type::kNull;
+  bool boolean = false;
+  double number = 0;
+  std::string string;
+  std::vector<Json> array;
+  std::map<std::string, Json> object;
+
+  // Returns the member named key, or null if there is none.
+  const Json& operator[](const std::string& key) const {
+    static const Json null;
+    auto it = object.find(key);
+    return it == object.end() ? null : it->second;
+  }
+};
+
+class JsonParser {
+ public:
+  explicit JsonParser(std::string_view src) : src_{src} {
+  }
+
+  bool Parse(Json& value) {
+    if (!ParseValue(value, 0)) {
+      return false;
+    }
+    SkipSpaces();
+    return pos_ == src_.size();
+  }
+
+ private:
+  void SkipSpaces() {
+    while (pos_ < src_.size() && isspace(src_[pos_])) {
+      ++pos_;
+    }
+  }
+
+  bool Read(char expected) {
+    SkipSpaces();
+    if (pos_ < src_.size() && src_[pos_] == expected) {
+      ++pos_;
+      return true;
+    }
+    return false;
+  }
+
+  bool ReadWord(std::string_view word) {
+    if (src_.substr(pos_, word.size()) != word) {
+      return false;
+    }
+    pos_ += word.size();
+    return true;
+  }
+
+  bool ParseValue(Json& value, size_t depth) {
+    SkipSpaces();
+    if (pos_ == src_.size() || depth > kMaxJsonDepth) {
+      return false;
+    }
+    char c = src_[pos_];
+    if (c == '{') {
+      value.type = Json::Type::kObject;
+      ++pos_;
+      if (Read('}')) {
+        return true;
+      }
+      do {
+        std::string key;
+        SkipSpaces();
+        if (!ParseString(key) || !Read(':') ||
+            !ParseValue(value.object[key], depth + 1)) {
+          return false;
+        }
+      } while (Read(','));
+      return Read('}');
+    } else if (c == '[') {
+      value.type = Json::Type::kArray;
+      ++pos_;
+      if (Read(']')) {
+        return true;
+      }
+      do {
+        value.array.emplace_back();
+        if (!ParseValue(value.array.back(), depth + 1)) {
+          return false;
+        }
+      } while (Read(','));
+      return Read(']');
+    } else if (c == '"') {
+      value.type = Json::Type::kString;
+      return ParseString(value.string);
+    } else if (ReadWord("true") || ReadWord("false")) {
+      value.type = Json::Type::kBool;
+      value.boolean = c == 't';
+      return true;
+    } else if (ReadWord("null")) {
+      return true;
+    }
+
+    std::string number;
+    while (pos_ < src_.size() && strchr("+-0123456789.eE", src_[pos_])) {
+      number += src_[pos_++];
+    }
+    char* end;
+    value.type = Json::Type::kNumber;
+    value.number = strtod(number.c_str(), &end);
+    return !number.empty() && *end == '\0';
+  }
+
+  bool ParseString(std::string& s) {
+    if (pos_ == src_.size() || src_[pos_] != '"') {
+      return false;
+    }
+    for (++pos_; pos_ < src_.size(); ++pos_) {
+      char c = src_[pos_];
+      if (c == '"') {
+        ++pos_;
+        return true;
+      } else if (c != '\\') {
+        s += c;
+        continue;
+      }
+      if (++pos_ == src_.size()) {
+        return false;
+      }
+      c = src_[pos_];
+      if (c == 'u') {
+        uint32_t code;
+        ++pos_;
+        if (!ReadHex4(code)) {
+          return false;
+        }
+        if (code >= 0xd800 && code < 0xdc00) {
+          uint32_t low;
+          if (!ReadWord("\\u") || !ReadHex4(low)) {
+            return false;
+          }
+          code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+        }
+        AppendUtf8(s, code);
+        --pos_;
+      } else if (auto p = strchr("b\bf\fn\nr\rt\t", c); p && c != '\0') {
+        s += p[1];
+      } else {
+        s += c;
+      }
+    }
+    return false;
+  }
+
+  bool ReadHex4(uint32_t& code) {
+    if (src_.size() - pos_ < 4) {
+      return false;
+    }
+    std::string digits{src_.substr(pos_, 4)};
+    char* end;
+    code = strtoul(digits.c_str(), &end, 16);
+    pos_ += 4;
+    return end == digits.c_str() + 4;
+  }
+
+  static void AppendUtf8(std::string& s, uint32_t code) {
+    if (code < 0x80) {
+      s += static_cast<char>(code);
+    } else if (code < 0x800) {
+      s += static_cast<char>(0xc0 | code >> 6);
+      s += static_cast<char>(0x80 | (code & 0x3f));
+    } else if (code < 0x10000) {
+      s += static_cast<char>(0xe0 | code >> 12);
+      s += static_cast<char>(0x80 | (code >> 6 & 0x3f));
+      s += static_cast<char>(0x80 | (code & 0x3f));
+    } else {
+      s += static_cast<char>(0xf0 | code >> 18);
+      s += static_cast<char>(0x80 | (code >> 12 & 0x3f));
+      s += static_cast<char>(0x80 | (code >> 6 & 0x3f));
+      s += static_cast<char>(0x80 | (code & 0x3f));
+    }
+  }
+
+  std::string_view src_;
+  size_t pos_ = 0;
+};
+
+std::string Quote(std::string_view s) {
+  std::string quoted = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+      quoted += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      quoted += escaped;
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + '"';
+}
+
+// Writes a request id back as it came: a number or a string.
+std::string IdToJson(const Json& id) {
+  if (id.type == Json::Type::kString) {
+    return Quote(id.string);
+  } else if (id.type == Json::Type::kNumber) {
+    return std::to_string(static_cast<long long>(id.number));
+  }
+  return "null";
+}
+
+struct DocumentError {
+  size_t begin, end; // offsets in the text
+  std::string message;
+};
+
+// The text of an open document with its tokens and declarations, which are
+// kept up to date through edits.
+//
+// An edit shifts the offsets of all tokens after it, and the token ranges of
+// all declarations after it. So that an edit costs little for the tokens far
+// from it, the shifts are kept pending: the offsets of the tokens from gap_ on
+// are off by gap_shift_, and the token ranges of the declarations from
+// decl_gap_ on by decl_shift_. They are applied as edits move the gaps.
+class Document {
+ public:
+  explicit Document(const std::string& text)
+      : tokens_{{TokenType::kEOF, 0}},
+        unit_{std::make_shared<TranslationUnit>()} {
+    Edit(0, 0, text);
+  }
+
+  const std::string& Text() const {
+    return text_;
+  }
+
+  // Replaces the bytes [begin, end) of the text with new_text.
+  void Edit(size_t begin, size_t end, const std::string& new_text) {
+    text_.replace(begin, end - begin, new_text);
+    size_t new_end = begin + new_text.size();
+
+    // A token is read the same as before if it ends before the edit, because
+    // no token depends on more than the one character after it. Reading starts
+    // after the last of them.
+    size_t first = PartitionPoint(tokens_.size(), [&](size_t i) {
+      return Offset(i) + tokens_[i].length < begin;
+    });
+    size_t start = first == 0 ?
+        0 : Offset(first - 1) + tokens_[first - 1].length;
+
+    // Reading stops at the first new token which begins where an old token
+    // after the edit began, as from there on the text is the same. The kEOF
+    // tokens always match.
+    size_t last = PartitionPoint(tokens_.size(), [&](size_t i) {
+      return Offset(i) < end;
+    });
+    auto shifted = [&](size_t i) { return Offset(i) - end + new_end; };
+    std::vector<Token> new_tokens;
+    SourceReader reader{text_.c_str(), start};
+    while (true) {
+      auto token = ReadNextToken(reader);
+      if (token.offset >= new_end) {
+        while (shifted(last) < token.offset) {
+          ++last;
+        }
+        if (shifted(last) == token.offset) {
+          break;
+        }
+      }
+      new_tokens.push_back(std::move(token));
+    }
+
+    MoveGap(last);
+    gap_shift_ += new_end - end;
+    for (size_t i = first; i < last; ++i) {
+      num_unknown_ -= tokens_[i].type == TokenType::kUnknown;
+    }
+    for (const auto& token : new_tokens) {
+      num_unknown_ += token.type == TokenType::kUnknown;
+    }
+    auto it = tokens_.begin() + first;
+    if (new_tokens.size() <= last - first) {
+      auto new_last = std::move(new_tokens.begin(), new_tokens.end(), it);
+      tokens_.erase(new_last, tokens_.begin() + last);
+    } else {
+      auto mid = new_tokens.begin() + (last - first);
+      std::move(new_tokens.begin(), mid, it);
+      tokens_.insert(tokens_.begin() + last, std::make_move_iterator(mid),
+                     std::make_move_iterator(new_tokens.end()));
+    }
+    gap_ = first + new_tokens.size();
+    Reparse(first, last, gap_);
+  }
+
+  std::vector<DocumentError> Errors() const {
+    std::vector<DocumentError> errors;
+    for (size_t i = 0; num_unknown_ > 0 && i < tokens_.size(); ++i) {
+      if (tokens_[i].type == TokenType::kUnknown) {
+        errors.push_back(TokenError(i, "Unknown character"));
+      }
+    }
+    // The parser fails at each unknown character too, which is reported above.
+    for (const auto& error : syntax_errors_) {
+      if (tokens_[error.token].type != TokenType::kUnknown) {
+        errors.push_back(TokenError(error.token, "Unexpected"));
+      }
+    }
+    return errors;
+  }
+
+ private:
+  // Returns the first i in [0, n) for which pred(i) is false, where pred is
+  // true up to some i and false from there on.
+  template <typename Pred>
+  static size_t PartitionPoint(size_t n, Pred pred) {
+    size_t lo = 0;
+    while (n > 0) {
+      size_t half = n / 2;
+      if (pred(lo + half)) {
+        lo += half + 1;
+        n -= half + 1;
+      } else {
+        n = half;
+      }
+    }
+    return lo;
+  }
+
+  size_t Offset(size_t i) const {
+    return i < gap_ ? tokens_[i].offset : tokens_[i].offset + gap_shift_;
+  }
+
+  void MoveGap(size_t i) {
+    for (; gap_ < i; ++gap_) {
+      tokens_[gap_].offset += gap_shift_;
+    }
+    while (gap_ > i) {
+      tokens_[--gap_].offset -= gap_shift_;
+    }
+  }
+
+  size_t TokenBegin(size_t k) const {
+    auto begin = unit_->decls[k]->token_begin;
+    return k < decl_gap_ ? begin : begin + decl_shift_;
+  }
+
+  size_t TokenEnd(size_t k) const {
+    auto end = unit_->decls[k]->token_end;
+    return k < decl_gap_ ? end : end + decl_shift_;
+  }
+
+  void MoveDeclGap(size_t k) {
+    auto& decls = unit_->decls;
+    for (; decl_gap_ < k; ++decl_gap_) {
+      decls[decl_gap_]->token_begin += decl_shift_;
+      decls[decl_gap_]->token_end += decl_shift_;
+    }
+    while (decl_gap_ > k) {
+      --decl_gap_;
+      decls[decl_gap_]->token_begin -= decl_shift_;
+      decls[decl_gap_]->token_end -= decl_shift_;
+    }
+  }
+
+  DocumentError TokenError(size_t i, const std::string& what) const {
+    auto begin = Offset(i), end = begin + tokens_[i].length;
+    if (tokens_[i].type == TokenType::kEOF) {
+      return {begin, end, what + " end of file"};
+    }
+    return {begin, end, what + " '" + text_.substr(begin, end - begin) + "'"};
+  }
+
+  // Parses the declarations again after the tokens [first, old_last) were
+  // replaced by [first, new_last). Declarations which end before first are
+  // kept, and so are those which began at or after old_last, from the first
+  // one which parsing reaches the start of. The syntax errors are kept or found
+  // again the same way.
+  void Reparse(size_t first, size_t old_last, size_t new_last) {
+    auto& decls = unit_->decls;
+    size_t keep = PartitionPoint(decls.size(), [&](size_t k) {
+      return TokenEnd(k) <= first;
+    });
+    size_t reuse = PartitionPoint(decls.size(), [&](size_t k) {
+      return TokenBegin(k) < old_last;
+    });
+    auto shifted = [&](size_t index) { return index - old_last + new_last; };
+
+    std::vector<std::shared_ptr<Declaration>> parsed;
+    std::vector<SyntaxError> errors;
+    size_t begin = keep == 0 ? 0 : TokenEnd(keep - 1);
+    TokenReader reader{tokens_, begin};
+    while (true) {
+      auto position = reader.Position();
+      while (reuse < decls.size() && shifted(TokenBegin(reuse)) < position) {
+        ++reuse;
+      }
+      if (reuse < decls.size() && shifted(TokenBegin(reuse)) == position) {
+        break;
+      }
+      if (reader.Current().type == TokenType::kEOF) {
+        reuse = decls.size();
+        break;
+      }
+      // After a syntax error, the reader is at the next declaration.
+      if (auto decl = ParseTopLevelDeclaration(reader, &errors)) {
+        parsed.push_back(decl);
+      }
+    }
+
+    // The syntax errors in and after the reused declarations are the same.
+    size_t reused_begin = reuse < decls.size() ? TokenBegin(reuse) : SIZE_MAX;
+    auto kept = std::partition_point(
+        syntax_errors_.begin(), syntax_errors_.end(),
+        [&](const SyntaxError& error) { return error.token < begin; });
+    auto reused = std::partition_point(
+        kept, syntax_errors_.end(),
+        [&](const SyntaxError& error) { return error.token < reused_begin; });
+    for (auto it = reused; it != syntax_errors_.end(); ++it) {
+      it->token = shifted(it->token);
+    }
+    auto erased = syntax_errors_.erase(kept, reused);
+    syntax_errors_.insert(erased, errors.begin(), errors.end());
+
+    MoveDeclGap(reuse);
+    decl_shift_ += new_last - old_last;
+    auto dropped = decls.erase(decls.begin() + keep, decls.begin() + reuse);
+    decls.insert(dropped, parsed.begin(), parsed.end());
+    decl_gap_ = keep + parsed.size();
+  }
+
+  std::string text_;
+  std::vector<Token> tokens_;
+  size_t gap_ = 0, gap_shift_ = 0;
+  size_t num_unknown_ = 0;
+  // The declarations, whose token ranges are those of the parser only before
+  // decl_gap_.
+  std::shared_ptr<TranslationUnit> unit_;
+  size_t decl_gap_ = 0, decl_shift_ = 0;
+  // The syntax errors, in the order of their tokens.
+  std::vector<SyntaxError> syntax_errors_;
+};
+
+// Returns the offset in text of an LSP position. Characters are counted in
+// bytes, which for the ASCII that the tokenizer accepts are the same as UTF-16
+// code units.
+size_t ToOffset(const std::string& text, const Json& position) {
+  auto line = static_cast<long>(position["line"].number);
+  size_t offset = 0;
+  for (; line > 0 && offset < text.size(); --line) {
+    auto newline = text.find('\n', offset);
+    offset = newline == std::string::npos ? text.size() : newline + 1;
+  }
+  auto line_end = std::min(text.find('\n', offset), text.size());
+  auto character = static_cast<size_t>(
+      std::max(position["character"].number, 0.0));
+  return std::min(offset + character, line_end);
+}
+
+std::string ToPosition(const std::string& text, size_t offset) {
+  auto begin = text.begin(), it = text.begin() + offset;
+  auto line = std::count(begin, it, '\n');
+  auto line_begin = text.rfind('\n', offset == 0 ? 0 : offset - 1);
+  auto character = line == 0 ? offset : offset - line_begin - 1;
+  return "{\"line\":" + std::to_string(line) +
+         ",\"character\":" + std::to_string(character) + "}";
+}
+
+// The largest message which is read. No document comes near it.
+const long kMaxContentLength = 64 << 20;
+
+// Reads a message framed by a Content-Length header. Returns false at the end
+// of the input, or if the message is longer than kMaxContentLength, as the
+// input cannot be followed past it.
+bool ReadMessage(std::istream& in, std::string& content) {
+  const std::string_view kContentLength = "Content-Length:";
+  long length = -1;
+  for (std::string line; std::getline(in, line); ) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (line.empty()) {
+      if (length < 0) {
+        continue;
+      }
+      if (length > kMaxContentLength) {
+        return false;
+      }
+      content.resize(length);
+      return static_cast<bool>(in.read(content.data(), length));
+    }
+    if (line.compare(0, kContentLength.size(), kContentLength) == 0) {
+      length = strtol(line.c_str() + kContentLength.size(), nullptr, 10);
+    }
+  }
+  return false;
+}
+
+class LanguageServer {
+ public:
+  explicit LanguageServer(std::ostream& out) : out_{out} {
+  }
+
+  // Handles a message. Returns false after the "exit" notification.
+  bool Handle(const Json& message) {
+    const auto& method = message["method"].string;
+    const auto& id = message["id"];
+    const auto& params = message["params"];
+    bool is_request = message.object.count("id");
+    if (method.empty()) {
+      if (is_request) {
+        RespondError(id, kInvalidRequest, "No method");
+      }
+    } else if (method == "initialize") {
+      Respond(id, "{\"capabilities\":{\"textDocumentSync\":"
+                  "{\"openClose\":true,\"change\":2}},"
+                  "\"serverInfo\":{\"name\":\"9cxx\"}}");
+    } else if (method == "shutdown") {
+      shutdown_ = true;
+      Respond(id, "null");
+    } else if (method == "exit") {
+      return false;
+    } else if (method == "textDocument/didOpen") {
+      const auto& doc = params["textDocument"];
+      auto it = documents_.insert_or_assign(
+          doc["uri"].string, Document{doc["text"].string}).first;
+      Publish(it->first, it->second);
+    } else if (method == "textDocument/didChange") {
+      const auto& uri = params["textDocument"]["uri"].string;
+      auto it = documents_.find(uri);
+      if (it == documents_.end()) {
+        return true;
+      }
+      auto& doc = it->second;
+      for (const auto& change : params["contentChanges"].array) {
+        const auto& range = change["range"];
+        if (range.type == Json::Type::kNull) {
+          doc.Edit(0, doc.Text().size(), change["text"].string);
+          continue;
+        }
+        auto begin = ToOffset(doc.Text(), range["start"]);
+        auto end = std::max(begin, ToOffset(doc.Text(), range["end"]));
+        doc.Edit(begin, end, change["text"].string);
+      }
+      Publish(uri, doc);
+    } else if (method == "textDocument/didClose") {
+      const auto& uri = params["textDocument"]["uri"].string;
+      documents_.erase(uri);
+      Notify("textDocument/publishDiagnostics",
+             "{\"uri\":" + Quote(uri) + ",\"diagnostics\":[]}");
+    } else if (is_request) {
+      RespondError(id, kMethodNotFound, "Unsupported method " + method);
+    }
+    return true;
+  }
+
+  int ExitCode() const {
+    return shutdown_ ? 0 : 1;
+  }
+
+  void RespondError(const Json& id, int code, const std::string& message) {
+    Send("{\"jsonrpc\":\"2.0\",\"id\":" + IdToJson(id) +
+         ",\"error\":{\"code\":" + std::to_string(code) +
+         ",\"message\":" + Quote(message) + "}}");
+  }
+
+ private:
+  void Send(const std::string& content) {
+    out_ << "Content-Length: " << content.size() << "\r\n\r\n" << content;
+    out_.flush();
+  }
+
+  void Respond(const Json& id, const std::string& result) {
+    Send("{\"jsonrpc\":\"2.0\",\"id\":" + IdToJson(id) +
+         ",\"result\":" + result + "}");
+  }
+
+  void Notify(const std::string& method, const std::string& params) {
+    Send("{\"jsonrpc\":\"2.0\",\"method\":" + Quote(method) +
+         ",\"params\":" + params + "}");
+  }
+
+  void Publish(const std::string& uri, const Document& doc) {
+    std::string diagnostics;
+    for (const auto& error : doc.Errors()) {
+      if (!diagnostics.empty()) {
+        diagnostics += ',';
+      }
+      diagnostics += "{\"range\":{\"start\":" +
+                     ToPosition(doc.Text(), error.begin) + ",\"end\":" +
+                     ToPosition(doc.Text(), error.end) +
+                     "},\"severity\":1,\"source\":\"9cxx\",\"message\":" +
+                     Quote(error.message) + "}";
+    }
+    Notify("textDocument/publishDiagnostics",
+           "{\"uri\":" + Quote(uri) + ",\"diagnostics\":[" + diagnostics +
+           "]}");
+  }
+
+  std::ostream& out_;
+  std::map<std::string, Document> documents_;
+  bool shutdown_ = false;
+};
+
+} // namespace
+
+int RunLanguageServer(std::istream& in, std::ostream& out) {
+  LanguageServer server{out};
+  for (std::string content; ReadMessage(in, content); ) {
+    Json message;
+    if (!JsonParser{content}.Parse(message) ||
+        message.type != Json::Type::kObject) {
+      server.RespondError({}, kParseError, "Invalid JSON");
+      continue;
+    }
+    if (!server.Handle(message)) {
+      return server.ExitCode();
+    }
+  }
+  return 1;
+}
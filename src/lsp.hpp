@@ -0,0 +1,14 @@
+#pragma once
+
+#include <iosfwd>
+
+// Serves the Language Server Protocol on in and out, as editors run language
+// servers over stdio. Each open document keeps its tokens and AST, and an edit
+// re-tokenizes only the text around it and re-parses only the declarations at
+// namespace scope which the changed tokens are in. The syntax errors of a
+// document are published after each change.
+//
+// Supported are initialize, shutdown, exit and the textDocument/didOpen,
+// didChange (full or incremental) and didClose notifications. Returns the exit
+// code for the "exit" notification, or 1 if the input ends before it.
+int RunLanguageServer(std::istream& in, std::ostream& out);
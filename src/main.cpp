@@ -1,459 +1,267 @@
+#include <algorithm>
 #include <cstdio>
+#include <climits>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
-#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <map>
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
-#include <map>
-#include <set>
-#include <array>
-#include <boost/format.hpp>
-
-#include "tokenizer.hpp"
-#include "parser.hpp"
-#include "ast.hpp"
-
-#define MAX_SOURCE_LENGTH (1024*1024)
-
-bool leading_underscore = true;
-
-template <typename T>
-boost::format& BoostFormat(boost::format& format_string, T head) {
-  return format_string % head;
-}
-
-template <typename Head, typename... Tail>
-boost::format& BoostFormat(boost::format& format_string, Head head, Tail... tail) {
-  return BoostFormat(format_string % head, tail...);
+#include <unistd.h>
+
+#include "cache.hpp"
+#include "compiler.hpp"
+#include "lsp.hpp"
+#include "server.hpp"
+#include "thread_pool.hpp"
+
+// Returns the path of the output file with the extension ext for the source
+// file src_path.
+std::string OutputPath(const std::string& src_path, const std::string& out_dir,
+                       const char* ext) {
+  auto name = src_path.substr(src_path.find_last_of('/') + 1);
+  name = name.substr(0, name.find_last_of('.')) + ext;
+  if (out_dir.empty()) {
+    return name;
+  }
+  if (out_dir.back() == '/') {
+    return out_dir + name;
+  }
+  return out_dir + '/' + name;
 }
 
-class AssemblyLine {
- public:
-  AssemblyLine(const std::string& line) : line_{line} {
-  }
-
-  template <typename... Args>
-  AssemblyLine& Format(Args... args) {
-    auto fmt = boost::format(line_);
-    line_ = BoostFormat(fmt, args...).str();
-    return *this;
-  }
-
-  const std::string& ToString() const {
-    return line_;
-  }
-
- private:
-  std::string line_;
-};
-
-enum class IdType {
-  kUnknown,
-  kLocalVariable,
-  kGlobal,
-};
-
-struct IdInfo {
-  IdType type;
-  size_t rbp_offset; // [rbp - rbp_offset]
-};
-
-const std::array<std::string, 6> kParamRegList{
-  "rdi",
-  "rsi",
-  "rdx",
-  "rcx",
-  "r8",
-  "r9",
-};
-
-std::string ExternName(const std::string& id_name) {
-  if (leading_underscore) {
-    return '_' + id_name;
+// Returns path, which is relative to the working directory, as an absolute
+// path.
+std::string AbsolutePath(const std::string& path) {
+  char cwd[PATH_MAX];
+  if (path.empty() || path[0] == '/' || !getcwd(cwd, sizeof(cwd))) {
+    return path;
   }
-  return id_name;
+  return std::string{cwd} + '/' + path;
 }
 
-class BaseVisitor : public Visitor {
- public:
-  void Visit(TranslationUnit* unit, bool lvalue) {
-    for (const auto& decl : unit->decls) {
-      decl->Accept(this, lvalue);
-    }
-  }
-  void Visit(CompoundStatement* stmt, bool lvalue) {}
-  void Visit(ExpressionStatement* stmt, bool lvalue) {}
-  void Visit(DeclarationStatement* stmt, bool lvalue) {}
-  void Visit(AssignmentExpression* exp, bool lvalue) {}
-  void Visit(EqualityExpression* exp, bool lvalue) {}
-  void Visit(AdditiveExpression* exp, bool lvalue) {}
-  void Visit(MultiplicativeExpression* exp, bool lvalue) {}
-  void Visit(FunctionCallExpression* exp, bool lvalue) {}
-  void Visit(IntegerLiteral* exp, bool lvalue) {}
-  void Visit(Identifier* exp, bool lvalue) {}
-  void Visit(SimpleDeclaration* decl, bool lvalue) {}
-  void Visit(SimpleTypeSpecifier* spec, bool lvalue) {}
-  void Visit(InitDeclarator* dtor, bool lvalue) {
-    dtor->dtor->Accept(this, lvalue);
-    if (dtor->init) dtor->init->Accept(this, lvalue);
-  }
-  void Visit(EqualInitializer* init, bool lvalue) {
-    init->clause->Accept(this, lvalue);
-  }
-  void Visit(InitializerClause* clause, bool lvalue) {
-    if (clause->assign) clause->assign->Accept(this, lvalue);
-    if (clause->braced) clause->braced->Accept(this, lvalue);
-  }
-  void Visit(NoPtrDeclarator* dtor, bool lvalue) {
-    dtor->id->Accept(this, lvalue);
-  }
-  void Visit(FunctionDeclarator* dtor, bool lvalue) {
-    dtor->decl->Accept(this, lvalue);
-    dtor->param->Accept(this, lvalue);
-  }
-  void Visit(ParameterDeclaration* decl, bool lvalue) {
-    decl->spec->Accept(this, lvalue);
-    decl->dtor->Accept(this, lvalue);
-  }
-  void Visit(ParametersAndQualifiers* pq, bool lvalue) {
-    for (const auto& decl : pq->params) {
-      decl->Accept(this, lvalue);
-    }
-  }
-  void Visit(FunctionDefinition* defn, bool lvalue) {
-    for (const auto& spec : defn->specs) {
-      spec->Accept(this, lvalue);
-    }
-    defn->dtor->Accept(this, lvalue);
-    defn->body->Accept(this, lvalue);
-  }
-};
-
-class DeclSpecifierVisitor : public BaseVisitor {
- public:
-  void Visit(SimpleTypeSpecifier* spec, bool lvalue) {
-    BaseVisitor::Visit(spec, lvalue);
-    simple_type_specifier_ = spec;
-  }
-
-  SimpleTypeSpecifier* SimpleTypeSpecifier() {
-    return simple_type_specifier_;
-  }
-
- private:
-  struct SimpleTypeSpecifier* simple_type_specifier_ = nullptr;
-};
-
-class InitDeclaratorVisitor : public BaseVisitor {
- public:
-  void Visit(InitializerClause* clause, bool lvalue) {
-    BaseVisitor::Visit(clause, lvalue);
-    initializer_clause_= clause;
-  }
-
-  void Visit(Identifier* id, bool lvalue) {
-    BaseVisitor::Visit(id, lvalue);
-    id_ = id;
-  }
-
-  void Visit(FunctionDeclarator* dtor, bool lvalue) {
-    BaseVisitor::Visit(dtor, lvalue);
-    function_declarator_ = dtor;
-  }
-
-  InitializerClause* InitializerClause() {
-    return initializer_clause_;
-  }
-
-  Identifier* Identifier() {
-    return id_;
-  }
-
-  FunctionDeclarator* FunctionDeclarator() {
-    return function_declarator_;
-  }
-
- private:
-  struct InitializerClause* initializer_clause_ = nullptr;
-  struct Identifier* id_ = nullptr;
-  struct FunctionDeclarator* function_declarator_ = nullptr;
-};
-
-class CodeGenerateVisitor : public BaseVisitor {
- public:
-  CodeGenerateVisitor(std::vector<AssemblyLine>& code)
-      : code_{code}, ids_{}, last_rbp_offset_{0} {
-  }
-
-  void Visit(CompoundStatement* stmt, bool lvalue) {
-    if (stmt->statements.empty()) {
-      code_.push_back(AssemblyLine("  xor rax, rax"));
-      return;
-    }
-
-    code_.push_back(AssemblyLine("  push rbp"));
-    code_.push_back(AssemblyLine("  mov rbp, rsp"));
-    code_.push_back(AssemblyLine("  sub rsp, %1%"));
-    size_t rsp_line = code_.size() - 1;
-
-    for (auto& n : stmt->statements) {
-      n->Accept(this, lvalue);
-    }
-
-    size_t stack_size = (last_rbp_offset_ + 15) & ~static_cast<size_t>(15);
-    if (stack_size == 0) {
-      code_.erase(code_.begin() + rsp_line);
-    } else {
-      code_[rsp_line].Format(stack_size);
-      code_.push_back(AssemblyLine("  mov rsp, rbp"));
+// Compiles each source file into out_dir, in parallel on options.num_jobs
+// threads. A file which fails to compile does not stop the others. Returns 0
+// if all files are compiled. cache may be null. If incremental, the code of
+// each function is kept in a sidecar file next to the output, and only changed
+// functions are generated again. If emit_ast, the ASTs are written to .ast
+// files instead of compiling.
+//
+// Nothing is compiled if two files would have the same output, as a/x.cpp and
+// b/x.cpp do.
+int CompileFiles(const std::vector<std::string>& src_paths,
+                 const std::string& out_dir, const CompileOptions& options,
+                 CompileCache* cache, bool incremental, bool emit_ast) {
+  std::map<std::string, std::string> sources; // by output path
+  for (const auto& src_path : src_paths) {
+    auto out_path = OutputPath(src_path, out_dir, emit_ast ? ".ast" : ".s");
+    auto [it, inserted] = sources.insert({out_path, src_path});
+    if (!inserted) {
+      std::cerr << it->second << " and " << src_path
+                << " would both be written to " << out_path << std::endl;
+      return -1;
     }
-    code_.push_back(AssemblyLine("  pop rbp"));
-  }
-
-  void Visit(ExpressionStatement* stmt, bool lvalue) {
-    stmt->exp->Accept(this, lvalue);
   }
 
-  void Visit(DeclarationStatement* stmt, bool lvalue) {
-    stmt->decl->Accept(this, lvalue);
-  }
+  std::vector<int> results(src_paths.size());
+  std::vector<std::string> errors(src_paths.size());
 
-  void Visit(AssignmentExpression* exp, bool lvalue) {
-    if (auto n = std::dynamic_pointer_cast<Identifier>(exp->lhs)) {
-      const auto& id_name = n->value;
-      if (ids_.find(id_name) == ids_.end()) {
-        std::cerr << "Undeclared identifier: " << id_name << std::endl;
+  ThreadPool pool{options.num_jobs};
+  auto file_options = options;
+  file_options.num_jobs = 1;
+  for (size_t i = 0; i < src_paths.size(); ++i) {
+    pool.Submit([&, i] {
+      std::ifstream in{src_paths[i]};
+      if (!in) {
+        errors[i] = "Cannot open the file\n";
+        results[i] = -1;
         return;
       }
-    }
-
-    exp->rhs->Accept(this, false);
-    code_.push_back(AssemblyLine("  push rax"));
-    exp->lhs->Accept(this, true);
-    code_.push_back(AssemblyLine("  pop rbx"));
-
-    code_.push_back(AssemblyLine("  mov [rax], rbx"));
-    if (!lvalue) {
-      code_.push_back(AssemblyLine("  mov rax, rbx"));
-    }
-  }
-
-  void Visit(EqualityExpression* exp, bool lvalue) {
-    exp->rhs->Accept(this, lvalue);
-    code_.push_back(AssemblyLine("  push rax"));
-    exp->lhs->Accept(this, lvalue);
-    code_.push_back(AssemblyLine("  pop rbx"));
-
-    const char* op_mnemonic = "";
-    if (exp->op == TokenType::kOpEqual) {
-      op_mnemonic = "sete";
-    } else if (exp->op == TokenType::kOpNotEqual) {
-      op_mnemonic = "setne";
-    }
-    code_.push_back(AssemblyLine("  cmp eax, ebx"));
-    code_.push_back(AssemblyLine("  %1% bl").Format(op_mnemonic));
-    code_.push_back(AssemblyLine("  xor rax, rax"));
-    code_.push_back(AssemblyLine("  mov al, bl"));
-  }
-
-  void Visit(AdditiveExpression* exp, bool lvalue) {
-    exp->rhs->Accept(this, lvalue);
-    code_.push_back(AssemblyLine("  push rax"));
-    exp->lhs->Accept(this, lvalue);
-    code_.push_back(AssemblyLine("  pop rbx"));
-
-    const char* op_mnemonic = "";
-    if (exp->op == TokenType::kOpPlus) {
-      op_mnemonic = "add";
-    } else if (exp->op == TokenType::kOpMinus) {
-      op_mnemonic = "sub";
-    }
-    code_.push_back(AssemblyLine("  %1% eax, ebx").Format(op_mnemonic));
-  }
-
-  void Visit(MultiplicativeExpression* exp, bool lvalue) {
-    exp->rhs->Accept(this, lvalue);
-    code_.push_back(AssemblyLine("  push rax"));
-    exp->lhs->Accept(this, lvalue);
-    code_.push_back(AssemblyLine("  pop rbx"));
-
-    const char* op_mnemonic = "";
-    if (exp->op == TokenType::kOpMult) {
-      op_mnemonic = "mul";
-    } else if (exp->op == TokenType::kOpDiv) {
-      op_mnemonic = "div";
-    }
-    code_.push_back(AssemblyLine("  xor rdx, rdx"));
-    code_.push_back(AssemblyLine("  %1% ebx").Format(op_mnemonic));
-  }
-
-  void Visit(FunctionCallExpression* exp, bool lvalue) {
-    if (auto n = std::dynamic_pointer_cast<Identifier>(exp->name)) {
-      const auto& id_name = n->value;
-      if (ids_.find(id_name) == ids_.end()) {
-        std::cerr << "Undeclared identifier: " << id_name << std::endl;
-        return;
+      std::string src{std::istreambuf_iterator<char>{in}, {}};
+
+      auto out_path = OutputPath(src_paths[i], out_dir,
+                                 emit_ast ? ".ast" : ".s");
+      auto fn_cache_path = out_path + ".fncache";
+      FunctionCache fn_cache;
+      if (incremental) {
+        fn_cache.Load(fn_cache_path);
       }
-    }
-
-    for (size_t i = 0; i < exp->args.size(); ++i) {
-      // reverse
-      exp->args[exp->args.size() - i - 1]->Accept(this, false);
-      code_.push_back(AssemblyLine("  push rax"));
-    }
-    for (size_t i = 0; i < exp->args.size(); ++i) {
-      if (i == kParamRegList.size()) break;
-      code_.push_back(AssemblyLine("  pop %1%").Format(kParamRegList[i]));
-    }
-    exp->name->Accept(this, true);
-    code_.push_back(AssemblyLine("  call rax"));
-  }
-
-  void Visit(IntegerLiteral* exp, bool lvalue) {
-    code_.push_back(AssemblyLine("  mov eax, %1%").Format(exp->value));
+      auto fn_cache_ptr = incremental ? &fn_cache : nullptr;
+
+      std::ofstream out{out_path, std::ios::binary};
+      std::ostringstream err;
+      if (!out) {
+        err << "Cannot open " << out_path << std::endl;
+        results[i] = -1;
+      } else if (emit_ast) {
+        results[i] = EmitAst(src, out, err);
+      } else if (cache) {
+        results[i] = CompileCached(*cache, src, out, err, file_options,
+                                   fn_cache_ptr);
+      } else {
+        results[i] = Compile(src, out, err, file_options, fn_cache_ptr);
+      }
+      if (results[i] == 0 && incremental) {
+        fn_cache.Save(fn_cache_path);
+      }
+      errors[i] = err.str();
+      if (results[i] != 0) {
+        out.close();
+        std::remove(out_path.c_str());
+      }
+    });
   }
+  pool.Wait();
 
-  void Visit(Identifier* exp, bool lvalue) {
-    const char* op_mnemonic = "";
-    const auto& id_name = exp->value;
-
-    if (lvalue) {
-      op_mnemonic = "lea";
-    } else {
-      op_mnemonic = "mov";
+  int result = 0;
+  for (size_t i = 0; i < src_paths.size(); ++i) {
+    std::istringstream err{errors[i]};
+    for (std::string line; std::getline(err, line); ) {
+      std::cerr << src_paths[i] << ": " << line << std::endl;
     }
-
-    if (ids_[id_name].type == IdType::kLocalVariable) {
-      code_.push_back(AssemblyLine("  %1% rax, [rbp - %2%]").Format(
-            op_mnemonic, ids_[id_name].rbp_offset));
-    } else if (ids_[id_name].type == IdType::kGlobal) {
-      code_.push_back(AssemblyLine("  mov rax, %1%").Format(ExternName(id_name)));
-    } else {
-      std::cerr << "Undefined symbol: " << id_name << std::endl;
+    if (results[i] != 0) {
+      result = -1;
     }
   }
+  return result;
+}
 
-  void Visit(SimpleDeclaration* decl, bool lvalue) {
-    DeclSpecifierVisitor v;
-    for (const auto& spec : decl->specs) {
-      spec->Accept(&v, false);
-    }
-
-    for (const auto& init_decl : decl->dtors) {
-      InitDeclaratorVisitor v2;
-      init_decl->Accept(&v2, false);
-      if (v2.FunctionDeclarator()) {
-        const auto& id_name = v2.Identifier()->value;
-        ids_[id_name].type = IdType::kGlobal;
-        code_.push_back(AssemblyLine("  extern %1%").Format(ExternName(id_name)));
-      } else {
-        last_rbp_offset_ += 8;
-        ids_[v2.Identifier()->value].type = IdType::kLocalVariable;
-        ids_[v2.Identifier()->value].rbp_offset = last_rbp_offset_;
-      }
+int main(int argc, char** argv) {
+  std::vector<std::string> args{argv + 1, argv + argc};
+  CompileOptions options;
+  std::vector<std::string> src_paths;
+  std::vector<std::string> compile_args;
+  std::string out_dir, server_path, client_path, cache_dir, fn_cache_path;
+  bool incremental = false;
+  bool emit_ast = false;
+  bool time_report = false;
+  uint64_t cache_size_mib = 256;
+  bool print_cache_stats = false;
+  bool jobs_given = false;
+  if (auto env = std::getenv("NINECXX_SERVER")) {
+    client_path = env;
+  }
+  if (auto env = std::getenv("NINECXX_CACHE_DIR")) {
+    cache_dir = env;
+  }
+  for (size_t i = 0; i < args.size(); ) {
+    if (auto n = ParseCompileOption(args, i, options)) {
+      jobs_given = jobs_given || args[i].compare(0, 2, "-j") == 0;
+      compile_args.insert(compile_args.end(),
+                          args.begin() + i, args.begin() + i + n);
+      i += n;
+    } else if (args[i] == "-o" && i + 1 < args.size()) {
+      out_dir = args[i + 1];
+      i += 2;
+    } else if (args[i] == "--server" && i + 1 < args.size()) {
+      server_path = args[i + 1];
+      i += 2;
+    } else if (args[i] == "--client" && i + 1 < args.size()) {
+      client_path = args[i + 1];
+      i += 2;
+    } else if (args[i] == "--cache-dir" && i + 1 < args.size()) {
+      cache_dir = args[i + 1];
+      i += 2;
+    } else if (args[i] == "--cache-size" && i + 1 < args.size()) {
+      cache_size_mib = std::strtoull(args[i + 1].c_str(), nullptr, 10);
+      i += 2;
+    } else if (args[i] == "-ftime-report") {
+      time_report = true;
+      ++i;
+    } else if (args[i] == "--incremental") {
+      incremental = true;
+      ++i;
+    } else if (args[i] == "--lsp") {
+      return RunLanguageServer(std::cin, std::cout);
+    } else if (args[i] == "--emit-ast") {
+      emit_ast = true;
+      ++i;
+    } else if (args[i] == "--function-cache" && i + 1 < args.size()) {
+      fn_cache_path = args[i + 1];
+      i += 2;
+    } else if (args[i] == "--cache-stats") {
+      print_cache_stats = true;
+      ++i;
+    } else if (args[i][0] == '-') {
+      std::cerr << "Unknown option or missing argument: " << args[i]
+                << std::endl;
+      return -1;
+    } else {
+      src_paths.push_back(args[i]);
+      ++i;
     }
   }
 
-  void Visit(SimpleTypeSpecifier* spec, bool lvalue) {
-  }
-
-  void Visit(InitDeclarator* dtor, bool lvalue) {
-  }
-
-  void Visit(EqualInitializer* init, bool lvalue) {
+  std::unique_ptr<CompileCache> cache;
+  if (!cache_dir.empty()) {
+    cache = std::make_unique<CompileCache>(cache_dir, cache_size_mib << 20);
   }
-
-  void Visit(InitializerClause* clause, bool lvalue) {
-    if (clause->assign) {
-      clause->assign->Accept(this, lvalue);
-    } else {
-      clause->braced->Accept(this, lvalue);
+  if (print_cache_stats) {
+    if (!cache) {
+      std::cerr << "--cache-stats needs --cache-dir" << std::endl;
+      return -1;
     }
+    auto stats = cache->GetStats();
+    std::cout << "hits " << stats.hits << std::endl
+              << "misses " << stats.misses << std::endl
+              << "entries " << stats.entries << std::endl
+              << "bytes " << stats.bytes << std::endl;
+    return 0;
   }
 
-  void Visit(NoPtrDeclarator* dtor, bool lvalue) {
+  if (!server_path.empty()) {
+    return RunServer(server_path, options.num_jobs);
   }
-
-  void Visit(FunctionDefinition* defn, bool lvalue) {
-    DeclSpecifierVisitor v;
-    for (const auto& spec : defn->specs) {
-      spec->Accept(&v, false);
-    }
-
-    InitDeclaratorVisitor v2;
-    defn->dtor->Accept(&v2, false);
-    if (!v2.Identifier()) {
-      std::cerr << "funcname must be specified" << std::endl;
-      return;
+  if (!src_paths.empty()) {
+    // Files are compiled on all cores unless -j says otherwise.
+    if (!jobs_given) {
+      options.num_jobs = std::max(std::thread::hardware_concurrency(), 1u);
     }
-
-    const auto& id_name = v2.Identifier()->value;
-    ids_[id_name].type = IdType::kGlobal;
-    auto extern_name = ExternName(id_name);
-    code_.push_back(AssemblyLine("global %1%").Format(extern_name));
-    code_.push_back(AssemblyLine("%1%:").Format(extern_name));
-
-    defn->body->Accept(this, false);
-
-    code_.push_back(AssemblyLine("  ret"));
+    return CompileFiles(src_paths, out_dir, options, cache.get(), incremental,
+                        emit_ast);
   }
 
- private:
-  std::vector<AssemblyLine>& code_;
-  std::map<std::string, IdInfo> ids_;
-  size_t last_rbp_offset_;
-};
-
-class CodeGenerator {
- public:
-  void Generate(std::shared_ptr<ASTNode> ast_root) {
-    CodeGenerateVisitor visitor{code_};
-    ast_root->Accept(&visitor, false);
-  }
-
-  const std::vector<AssemblyLine>& GetCode() const {
-    return code_;
+  std::string src{std::istreambuf_iterator<char>{std::cin}, {}};
+  if (emit_ast) {
+    return EmitAst(src, std::cout, std::cerr);
   }
-
- private:
-  std::vector<AssemblyLine> code_;
-};
-
-int main(int argc, char** argv) {
-  for (int i = 0; i < argc; ++i) {
-    if (strcmp("-fno-leading-underscore", argv[i]) == 0) {
-      leading_underscore = false;
+  if (!client_path.empty()) {
+    // The server has its own working directory, so the profile is named by
+    // its absolute path, which overrides the one given before.
+    if (!options.profile_use.empty()) {
+      compile_args.push_back("-fprofile-use=" +
+                             AbsolutePath(options.profile_use));
     }
-  }
-
-  char src[MAX_SOURCE_LENGTH];
-  fread(src, MAX_SOURCE_LENGTH, 1, stdin);
-
-  SourceReader src_reader{src};
-
-  std::vector<Token> tokens;
-  auto result = Tokenize(src_reader, tokens);
-  if (!result.success) {
-    fprintf(stderr, "Tokenize failed at token %lu\n", result.value);
-    for (size_t i = 0; i < result.value; ++i) {
-      fprintf(stderr, " %s", GetTokenName(tokens[i].type));
+    // Falls back to compiling in this process if the server is not running.
+    bool connected;
+    auto result = RunClient(client_path, compile_args, src,
+                            std::cout, std::cerr, connected);
+    if (connected) {
+      return result;
     }
-    fprintf(stderr, "\n");
-    return -1;
-  }
-
-  TokenReader token_reader{tokens};
-
-  auto ast = Parse(token_reader);
-  if (!ast) {
-    fprintf(stderr, "Parse error\n");
-    return -1;
-  }
-
-  CodeGenerator generator;
-  generator.Generate(ast);
-  for (auto& line : generator.GetCode()) {
-    std::cout << line.ToString() << std::endl;
   }
-  return 0;
+  FunctionCache fn_cache;
+  FunctionCache* fn_cache_ptr = nullptr;
+  if (!fn_cache_path.empty()) {
+    fn_cache.Load(fn_cache_path);
+    fn_cache_ptr = &fn_cache;
+  }
+  CompileStats stats;
+  auto result = cache ?
+      CompileCached(*cache, src, std::cout, std::cerr, options, fn_cache_ptr,
+                    &stats) :
+      Compile(src, std::cout, std::cerr, options, fn_cache_ptr, &stats);
+  if (result == 0 && fn_cache_ptr) {
+    fn_cache.Save(fn_cache_path);
+  }
+  if (time_report) {
+    WriteStatsJson(stats, std::cerr);
+    std::cerr << std::endl;
+  }
+  return result;
 }
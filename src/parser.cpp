@@ -1,51 +1,160 @@
 #include "parser.hpp"
 
+#include <cstdlib>
 #include <iostream>
 #include "ast.hpp"
 
+namespace {
+
+// Debug traces of the parser, printed if NINECXX_TRACE_PARSER is set.
+std::ostream& Trace() {
+  static const bool enabled = std::getenv("NINECXX_TRACE_PARSER");
+  thread_local std::ostream null_stream{nullptr};
+  return enabled ? std::cerr : null_stream;
+}
+
+// The spellings of the tokens which are the same each time, by TokenType.
+const char* const kTokenSpellings[] = {
+  "", "", "", "+", "-", "*", "/", "==", "!=", "=", "(", ")", "{", "}", ",", ";",
+};
+
+std::string Describe(const Token& token) {
+  if (token.type == TokenType::kEOF) {
+    return "end of file";
+  } else if (token.type == TokenType::kInteger) {
+    return "'" + std::to_string(token.int_value) + "'";
+  } else if (token.type == TokenType::kId ||
+             token.type == TokenType::kKeyword) {
+    return "'" + token.string_value + "'";
+  } else if (token.type == TokenType::kUnknown) {
+    return "an unknown token";
+  }
+  return std::string{"'"} + kTokenSpellings[static_cast<int>(token.type)] + "'";
+}
+
+} // namespace
+
 class Parser {
  public:
-  Parser(TokenReader& reader) : reader_{reader} {
+  Parser(TokenReader& reader, std::vector<SyntaxError>* errors = nullptr)
+      : reader_{reader}, errors_{errors} {
   }
 
   bool Parse() {
-    auto n = std::make_shared<TranslationUnit>();
-    std::cerr << "parsing translation unit (parsing declaration)" << std::endl;
-    auto decl = ParseDeclaration();
-    while (decl) {
-      n->decls.push_back(decl);
-      std::cerr << "parsing translation unit (parsing declaration)" << std::endl;
-      decl = ParseDeclaration();
+    auto n = MakeNode<TranslationUnit>();
+    size_t num_errors = errors_ ? errors_->size() : 0;
+    bool success = true;
+    while (reader_.Current().type != TokenType::kEOF) {
+      Trace() << "parsing translation unit (parsing declaration)" << std::endl;
+      auto decl = ParseTopLevelDeclaration();
+      if (decl) {
+        n->decls.push_back(decl);
+        continue;
+      }
+      success = false;
+      if (!Recover(false)) {
+        break;
+      }
     }
     ast_root_ = n;
-    return reader_.Read(TokenType::kEOF);
+    // Errors in blocks are recovered from without failing the declaration.
+    return success && (!errors_ || errors_->size() == num_errors);
+  }
+
+  std::shared_ptr<Declaration> ParseTopLevelDeclaration() {
+    auto begin = reader_.Position();
+    auto decl = ParseDeclaration();
+    if (decl) {
+      decl->token_begin = begin;
+      decl->token_end = reader_.Position();
+    }
+    return decl;
+  }
+
+  // Records the syntax error at the current token and skips the tokens up to
+  // the next declaration, as Parse() does.
+  void SkipDeclaration() {
+    Recover(false);
   }
 
   const std::shared_ptr<ASTNode> GetAST() const {
     return ast_root_;
   }
 
+  size_t NumNodes() const {
+    return num_nodes_;
+  }
+
  private:
+  template <typename T>
+  std::shared_ptr<T> MakeNode() {
+    ++num_nodes_;
+    return std::make_shared<T>();
+  }
+
+  // Records a syntax error at the current token and skips the tokens after it
+  // with Synchronize(). Returns false if errors are not collected or the tokens
+  // end, in which case the caller fails as well.
+  bool Recover(bool in_block) {
+    if (!errors_) {
+      return false;
+    }
+    // An error ends all the constructs it is in, but is reported once.
+    auto position = reader_.Position();
+    if (errors_->empty() || errors_->back().token != position) {
+      errors_->push_back({position, "Unexpected " + Describe(reader_.Current())});
+    }
+    Synchronize(in_block);
+    return reader_.Current().type != TokenType::kEOF;
+  }
+
+  // Skips tokens up to and including the next ';', or the '}' which closes a
+  // '{' skipped before it. In a block, a '}' which closes the block is left
+  // for the block to read; at namespace scope it is skipped.
+  void Synchronize(bool in_block) {
+    size_t depth = 0;
+    while (true) {
+      auto type = reader_.Current().type;
+      if (type == TokenType::kEOF ||
+          (type == TokenType::kRBrace && depth == 0 && in_block)) {
+        return;
+      }
+      reader_.Read();
+      if (type == TokenType::kLBrace) {
+        ++depth;
+      } else if (type == TokenType::kRBrace) {
+        if (depth <= 1) {
+          return;
+        }
+        --depth;
+      } else if (type == TokenType::kSemicolon && depth == 0) {
+        return;
+      }
+    }
+  }
+
   TokenReader& reader_;
+  std::vector<SyntaxError>* errors_;
   std::shared_ptr<ASTNode> ast_root_;
+  size_t num_nodes_ = 0;
 
   std::shared_ptr<Statement> ParseStatement() {
-    std::cerr << "ParseStatement: begin. current token is " << GetTokenName(reader_.Current().type) << std::endl;
+    Trace() << "ParseStatement: begin. current token is " << GetTokenName(reader_.Current().type) << std::endl;
     if (reader_.Current().type == TokenType::kLBrace) {
-      std::cerr << "parsing comp stmt" << std::endl;
+      Trace() << "parsing comp stmt" << std::endl;
       return ParseCompoundStatement();
     } else if (reader_.Current().type == TokenType::kKeyword) {
-      std::cerr << "token is keyword --> parsing decl stmt" << std::endl;
+      Trace() << "token is keyword --> parsing decl stmt" << std::endl;
       auto stmt = ParseDeclarationStatement();
-      std::cerr << "  parsed decl stmt" << std::endl;
+      Trace() << "  parsed decl stmt" << std::endl;
       return stmt;
     }
-    std::cerr << "token is not keyword --> parsing exp stmt" << std::endl;
+    Trace() << "token is not keyword --> parsing exp stmt" << std::endl;
     return ParseExpressionStatement();
   }
 
   std::shared_ptr<Statement> ParseCompoundStatement() {
-    std::cerr << "ParseCompoundStatemnt: begin. current token is " << GetTokenName(reader_.Current().type) << std::endl;
+    Trace() << "ParseCompoundStatemnt: begin. current token is " << GetTokenName(reader_.Current().type) << std::endl;
     if (!reader_.Read(TokenType::kLBrace)) {
       return {};
     }
@@ -53,23 +162,26 @@ class Parser {
     std::vector<std::shared_ptr<Statement>> statements;
 
     while (reader_.Current().type != TokenType::kRBrace) {
-      std::cerr << "ParseCompoundStatement: parsing a statement" << std::endl;
+      Trace() << "ParseCompoundStatement: parsing a statement" << std::endl;
       auto stmt = ParseStatement();
       if (!stmt) {
-        std::cerr << "ParseCompoundStatement: A statement should be there."
+        Trace() << "ParseCompoundStatement: A statement should be there."
                   << std::endl;
-        return {};
+        if (!Recover(true)) {
+          return {};
+        }
+        continue;
       }
       statements.push_back(stmt);
     }
 
     if (!reader_.Read(TokenType::kRBrace)) {
-      std::cerr << "ParseCompoundStatement: kRBrace is needed. actual "
+      Trace() << "ParseCompoundStatement: kRBrace is needed. actual "
                 << GetTokenName(reader_.Current().type) << std::endl;
       return {};
     }
 
-    auto n = std::make_shared<CompoundStatement>();
+    auto n = MakeNode<CompoundStatement>();
     n->statements = statements;
     return n;
   }
@@ -78,7 +190,7 @@ class Parser {
     auto decl = ParseBlockDeclaration();
     if (!decl) return {};
 
-    auto n = std::make_shared<DeclarationStatement>();
+    auto n = MakeNode<DeclarationStatement>();
     n->decl = decl;
     return n;
   }
@@ -89,7 +201,7 @@ class Parser {
       return {};
     }
 
-    auto n = std::make_shared<ExpressionStatement>();
+    auto n = MakeNode<ExpressionStatement>();
     n->exp = exp;
     return n;
   }
@@ -100,6 +212,9 @@ class Parser {
 
   std::shared_ptr<Expression> ParseAssignmentExpression() {
     auto lhs = ParseEqualityExpression();
+    if (!lhs) {
+      return {};
+    }
 
     TokenType op;
     if (reader_.Read(TokenType::kOpAssign)) {
@@ -113,7 +228,7 @@ class Parser {
       return {};
     }
 
-    auto n = std::make_shared<AssignmentExpression>();
+    auto n = MakeNode<AssignmentExpression>();
     n->lhs = lhs;
     n->op = op;
     n->rhs = rhs;
@@ -122,89 +237,109 @@ class Parser {
 
   std::shared_ptr<Expression> ParseEqualityExpression() {
     auto lhs = ParseAdditiveExpression();
-
-    TokenType op;
-    if (reader_.Read(TokenType::kOpEqual)) {
-      op = TokenType::kOpEqual;
-    } else if (reader_.Read(TokenType::kOpNotEqual)) {
-      op = TokenType::kOpNotEqual;
-    } else {
-      return lhs;
-    }
-
-    auto rhs = ParseEqualityExpression();
-    if (!rhs) {
+    if (!lhs) {
       return {};
     }
 
-    auto n = std::make_shared<EqualityExpression>();
-    n->lhs = lhs;
-    n->op = op;
-    n->rhs = rhs;
-    return n;
-  }
+    while (true) {
+      TokenType op;
+      if (reader_.Read(TokenType::kOpEqual)) {
+        op = TokenType::kOpEqual;
+      } else if (reader_.Read(TokenType::kOpNotEqual)) {
+        op = TokenType::kOpNotEqual;
+      } else {
+        return lhs;
+      }
 
-  std::shared_ptr<Expression> ParseAdditiveExpression() {
-    auto lhs = ParseMultiplicativeExpression();
+      auto rhs = ParseAdditiveExpression();
+      if (!rhs) {
+        return {};
+      }
 
-    TokenType op;
-    if (reader_.Read(TokenType::kOpPlus)) {
-      op = TokenType::kOpPlus;
-    } else if (reader_.Read(TokenType::kOpMinus)) {
-      op = TokenType::kOpMinus;
-    } else {
-      return lhs;
+      auto n = MakeNode<EqualityExpression>();
+      n->lhs = lhs;
+      n->op = op;
+      n->rhs = rhs;
+      lhs = n;
     }
+  }
 
-    auto rhs = ParseAdditiveExpression();
-    if (!rhs) {
+  std::shared_ptr<Expression> ParseAdditiveExpression() {
+    auto lhs = ParseMultiplicativeExpression();
+    if (!lhs) {
       return {};
     }
 
-    auto n = std::make_shared<AdditiveExpression>();
-    n->lhs = lhs;
-    n->op = op;
-    n->rhs = rhs;
-    return n;
-  }
+    // The operators are left-associative: a - b + c is (a - b) + c.
+    while (true) {
+      TokenType op;
+      if (reader_.Read(TokenType::kOpPlus)) {
+        op = TokenType::kOpPlus;
+      } else if (reader_.Read(TokenType::kOpMinus)) {
+        op = TokenType::kOpMinus;
+      } else {
+        return lhs;
+      }
 
-  std::shared_ptr<Expression> ParseMultiplicativeExpression() {
-    auto lhs = ParsePostfixExpression();
+      auto rhs = ParseMultiplicativeExpression();
+      if (!rhs) {
+        return {};
+      }
 
-    TokenType op;
-    if (reader_.Read(TokenType::kOpMult)) {
-      op = TokenType::kOpMult;
-    } else if (reader_.Read(TokenType::kOpDiv)) {
-      op = TokenType::kOpDiv;
-    } else {
-      return lhs;
+      auto n = MakeNode<AdditiveExpression>();
+      n->lhs = lhs;
+      n->op = op;
+      n->rhs = rhs;
+      lhs = n;
     }
+  }
 
-    auto rhs = ParseMultiplicativeExpression();
-    if (!rhs) {
+  std::shared_ptr<Expression> ParseMultiplicativeExpression() {
+    auto lhs = ParsePostfixExpression();
+    if (!lhs) {
       return {};
     }
 
-    auto n = std::make_shared<MultiplicativeExpression>();
-    n->lhs = lhs;
-    n->op = op;
-    n->rhs = rhs;
-    return n;
+    while (true) {
+      TokenType op;
+      if (reader_.Read(TokenType::kOpMult)) {
+        op = TokenType::kOpMult;
+      } else if (reader_.Read(TokenType::kOpDiv)) {
+        op = TokenType::kOpDiv;
+      } else {
+        return lhs;
+      }
+
+      auto rhs = ParsePostfixExpression();
+      if (!rhs) {
+        return {};
+      }
+
+      auto n = MakeNode<MultiplicativeExpression>();
+      n->lhs = lhs;
+      n->op = op;
+      n->rhs = rhs;
+      lhs = n;
+    }
   }
 
   std::shared_ptr<Expression> ParsePostfixExpression() {
     auto main = ParsePrimaryExpression();
+    if (!main) {
+      return {};
+    }
 
     if (reader_.Read(TokenType::kLParen)) {
-      auto n = std::make_shared<FunctionCallExpression>();
+      auto n = MakeNode<FunctionCallExpression>();
       n->name = main;
-      auto arg = ParseInitializerClause();
-      if (arg) n->args.push_back(arg);
-      while (reader_.Read(TokenType::kComma)) {
-        arg = ParseInitializerClause();
+      if (reader_.Read(TokenType::kRParen)) {
+        return n;
+      }
+      do {
+        auto arg = ParseInitializerClause();
         if (!arg) return {};
         n->args.push_back(arg);
-      }
+      } while (reader_.Read(TokenType::kComma));
       if (reader_.Read(TokenType::kRParen)) {
         return n;
       }
@@ -219,16 +354,15 @@ class Parser {
   std::shared_ptr<Expression> ParsePrimaryExpression() {
     if (reader_.Read(TokenType::kLParen)) {
       auto exp = ParseExpression();
-      auto token = reader_.Read();
-      if (token.type == TokenType::kRParen) {
+      if (exp && reader_.Read(TokenType::kRParen)) {
         return exp;
       }
-      std::cerr << "ParsePrimaryExpression: kRParen expected: "
-                << GetTokenName(token.type);
+      Trace() << "ParsePrimaryExpression: kRParen expected: "
+                << GetTokenName(reader_.Current().type);
       return {};
     } else if (reader_.Current().type == TokenType::kId) {
       auto token = reader_.Read();
-      auto n = std::make_shared<Identifier>();
+      auto n = MakeNode<Identifier>();
       n->value = token.string_value;
       return n;
     }
@@ -244,13 +378,13 @@ class Parser {
 
   std::shared_ptr<Expression> ParseIntegerLiteral() {
     auto token = reader_.Read();
-    auto n = std::make_shared<IntegerLiteral>();
+    auto n = MakeNode<IntegerLiteral>();
     n->value = token.int_value;
     return n;
   }
 
   std::shared_ptr<Declaration> ParseDeclaration() {
-    std::cerr << "ParseDeclaration" << std::endl;
+    Trace() << "ParseDeclaration" << std::endl;
     auto specs = ParseDeclSpecifierSeq();
     if (specs.empty()) return {};
 
@@ -259,7 +393,8 @@ class Parser {
 
     if (reader_.Current().type == TokenType::kLBrace) {
       auto body = ParseCompoundStatement();
-      auto n = std::make_shared<FunctionDefinition>();
+      if (!body) return {};
+      auto n = MakeNode<FunctionDefinition>();
       n->specs = specs;
       n->dtor = dtor;
       n->body = body;
@@ -276,7 +411,7 @@ class Parser {
   }
 
   std::shared_ptr<BlockDeclaration> ParseBlockDeclaration() {
-    std::cerr << "ParseBlockDeclaration" << std::endl;
+    Trace() << "ParseBlockDeclaration" << std::endl;
     auto specs = ParseDeclSpecifierSeq();
     if (specs.empty()) return {};
     auto dtor = ParseDeclarator();
@@ -286,17 +421,21 @@ class Parser {
   std::shared_ptr<SimpleDeclaration> ParseSimpleDeclaration(
       const std::vector<std::shared_ptr<DeclSpecifier>>& specs,
       const std::shared_ptr<Declarator>& dtor) {
-    auto n = std::make_shared<SimpleDeclaration>();
+    auto n = MakeNode<SimpleDeclaration>();
     n->specs = specs;
 
     auto init_dtor = ParseInitDeclarator(dtor);
-    if (init_dtor) n->dtors.push_back(init_dtor);
+    if (init_dtor) {
+      n->dtors.push_back(init_dtor);
+    } else if (dtor) {
+      return {};
+    }
     while (reader_.Read(TokenType::kComma)) {
       init_dtor = ParseInitDeclarator();
       if (!init_dtor) return {};
       n->dtors.push_back(init_dtor);
     }
-    std::cerr << "ParseSimpleDeclaration: size of dtors = " << n->dtors.size() << std::endl;
+    Trace() << "ParseSimpleDeclaration: size of dtors = " << n->dtors.size() << std::endl;
 
     if (!reader_.Read(TokenType::kSemicolon)) {
       return {};
@@ -304,17 +443,30 @@ class Parser {
     return n;
   }
 
+  // The sequence must contain a type specifier.
   std::vector<std::shared_ptr<DeclSpecifier>> ParseDeclSpecifierSeq() {
     std::vector<std::shared_ptr<DeclSpecifier>> specs;
+    bool has_type = false;
     auto spec = ParseDeclSpecifier();
     while (spec) {
+      has_type = has_type || std::dynamic_pointer_cast<SimpleTypeSpecifier>(spec);
       specs.push_back(spec);
       spec = ParseDeclSpecifier();
     }
+    if (!has_type) {
+      return {};
+    }
     return specs;
   }
 
   std::shared_ptr<DeclSpecifier> ParseDeclSpecifier() {
+    if (reader_.Current().type == TokenType::kKeyword &&
+        reader_.Current().string_value == "static") {
+      reader_.Read();
+      auto n = MakeNode<StorageClassSpecifier>();
+      n->value = "static";
+      return n;
+    }
     return ParseSimpleTypeSpecifier();
   }
 
@@ -323,11 +475,13 @@ class Parser {
       return {};
     }
     auto token = reader_.Read();
-    if (kBasicTypes.find(token.string_value) == kBasicTypes.end()) {
+    auto it = kBasicTypes.find(token.string_value);
+    if (it == kBasicTypes.end()) {
       return {};
     }
-    auto n = std::make_shared<SimpleTypeSpecifier>();
+    auto n = MakeNode<SimpleTypeSpecifier>();
     n->type = token.string_value;
+    n->type_info = &it->second;
     return n;
   }
 
@@ -336,14 +490,17 @@ class Parser {
     if (!dtor) {
       return {};
     }
-    auto n = std::make_shared<InitDeclarator>();
+    auto n = MakeNode<InitDeclarator>();
     n->dtor = dtor;
-    n->init = ParseInitializer();;
+    if (reader_.Current().type == TokenType::kOpAssign) {
+      n->init = ParseInitializer();
+      if (!n->init) return {};
+    }
     return n;
   }
 
   std::shared_ptr<InitDeclarator> ParseInitDeclarator() {
-    std::cerr << "ParseInitDeclarator" << std::endl;
+    Trace() << "ParseInitDeclarator" << std::endl;
     return ParseInitDeclarator(ParseDeclarator());
   }
 
@@ -352,11 +509,14 @@ class Parser {
   }
 
   std::shared_ptr<EqualInitializer> ParseEqualInitializer() {
+    if (!reader_.Read(TokenType::kOpAssign)) {
+      return {};
+    }
     auto clause = ParseInitializerClause();
     if (!clause) {
       return {};
     }
-    auto n = std::make_shared<EqualInitializer>();
+    auto n = MakeNode<EqualInitializer>();
     n->clause = clause;
     return n;
   }
@@ -370,7 +530,7 @@ class Parser {
     if (!assign && !braced) {
       return {};
     }
-    auto n = std::make_shared<InitializerClause>();
+    auto n = MakeNode<InitializerClause>();
     n->assign = assign;
     n->braced = braced;
     return n;
@@ -379,8 +539,8 @@ class Parser {
   std::shared_ptr<Declarator> ParseDeclarator() {
     auto decl = ParseNoPtrDeclarator();
     if (auto param = ParseParametersAndQualifiers()) {
-      auto n = std::make_shared<FunctionDeclarator>();
-      std::cerr << "function dtor" << std::endl;
+      auto n = MakeNode<FunctionDeclarator>();
+      Trace() << "function dtor" << std::endl;
       n->decl = decl;
       n->param = param;
       return n;
@@ -393,8 +553,8 @@ class Parser {
       return {};
     }
     auto id = reader_.Read().string_value;
-    auto n = std::make_shared<NoPtrDeclarator>();
-    n->id = std::make_shared<Identifier>();
+    auto n = MakeNode<NoPtrDeclarator>();
+    n->id = MakeNode<Identifier>();
     n->id->value = id;
     return n;
   }
@@ -403,7 +563,7 @@ class Parser {
     if (!reader_.Read(TokenType::kLParen)) {
       return {};
     }
-    auto n = std::make_shared<ParametersAndQualifiers>();
+    auto n = MakeNode<ParametersAndQualifiers>();
     auto decl = ParseParameterDeclaration();
     if (decl) n->params.push_back(decl);
     while (reader_.Read(TokenType::kComma)) {
@@ -419,7 +579,7 @@ class Parser {
   }
 
   std::shared_ptr<ParameterDeclaration> ParseParameterDeclaration() {
-    auto spec = ParseDeclSpecifier();
+    auto spec = ParseSimpleTypeSpecifier();
     if (!spec) {
       return {};
     }
@@ -427,17 +587,32 @@ class Parser {
     if (!dtor) {
       return {};
     }
-    auto n = std::make_shared<ParameterDeclaration>();
+    auto n = MakeNode<ParameterDeclaration>();
     n->spec = spec;
     n->dtor = dtor;
     return n;
   }
 };
 
-std::shared_ptr<ASTNode> Parse(TokenReader& reader) {
-  Parser p{reader};
-  if (!p.Parse()) {
+std::shared_ptr<ASTNode> Parse(TokenReader& reader, size_t* num_nodes,
+                               std::vector<SyntaxError>* errors) {
+  Parser p{reader, errors};
+  bool success = p.Parse();
+  if (num_nodes) {
+    *num_nodes = p.NumNodes();
+  }
+  if (!success) {
     return {};
   }
   return p.GetAST();
 }
+
+std::shared_ptr<Declaration> ParseTopLevelDeclaration(
+    TokenReader& reader, std::vector<SyntaxError>* errors) {
+  Parser p{reader, errors};
+  auto decl = p.ParseTopLevelDeclaration();
+  if (!decl && errors) {
+    p.SkipDeclaration();
+  }
+  return decl;
+}
@@ -3,11 +3,12 @@
 #include <vector>
 #include <memory>
 #include "tokenizer.hpp"
+#include "type.hpp"
 
 class TokenReader {
  public:
-  TokenReader(const std::vector<Token>& tokens)
-      : src_{tokens}, read_pos_{0} {
+  TokenReader(const std::vector<Token>& tokens, size_t position = 0)
+      : src_{tokens}, read_pos_{position} {
   }
 
   const Token& Read() {
@@ -22,6 +23,11 @@ class TokenReader {
     return src_[read_pos_];
   }
 
+  // Returns the index of the current token.
+  size_t Position() const {
+    return read_pos_;
+  }
+
   bool Read(TokenType expected) {
     if (src_[read_pos_].type == expected) {
       if (read_pos_ < src_.size() - 1) {
@@ -37,10 +43,29 @@ class TokenReader {
   size_t read_pos_;
 };
 
-const std::set<std::string> kBasicTypes{
-  "char",
-  "int",
+struct ASTNode;
+struct Declaration;
+
+struct SyntaxError {
+  size_t token; // the index of the token where parsing failed
+  std::string message;
 };
 
-struct ASTNode;
-std::shared_ptr<ASTNode> Parse(TokenReader& reader);
+// Parses a translation unit. Returns null on a syntax error. If num_nodes is
+// given, it receives the number of AST nodes created.
+//
+// If errors is given, parsing goes on after a syntax error: the tokens up to
+// the next ';' or '}' are skipped, and parsing resumes with the next statement
+// or declaration. errors then receives every syntax error in the unit.
+std::shared_ptr<ASTNode> Parse(TokenReader& reader, size_t* num_nodes = nullptr,
+                               std::vector<SyntaxError>* errors = nullptr);
+
+// Parses a declaration at namespace scope from the current token and sets its
+// token range. Returns null on a syntax error, leaving the reader where the
+// error is, or if there is no declaration to parse.
+//
+// If errors is given, syntax errors are recovered from as Parse() does: those
+// in blocks do not fail the declaration, and after the one that does, the
+// reader is left at the next declaration. errors receives each of them.
+std::shared_ptr<Declaration> ParseTopLevelDeclaration(
+    TokenReader& reader, std::vector<SyntaxError>* errors = nullptr);
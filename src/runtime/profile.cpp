@@ -0,0 +1,81 @@
+// Runtime of -fprofile-generate. Link it into programs with instrumented
+// code.
+//
+// Each instrumented translation unit registers its counter table from a
+// constructor, and the counts are added to the profile when the program exits.
+// The profile is a text file with a line "name count" per counter: the counter
+// of the entry to a function is named after the function, and that of its
+// index-th call site "function#index". The file is $NINECXX_PROFILE, or
+// 9cxx.profile in the current directory. Counts already in it are added to, so
+// runs of the program accumulate.
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Layout of the table emitted by 9cxx: the number of functions, followed by
+// an entry per function.
+struct FunctionCounters {
+  const char* name;
+  const uint64_t* counters;
+  uint64_t num_counters;
+};
+
+std::vector<const uint64_t*>& Tables() {
+  static std::vector<const uint64_t*> tables;
+  return tables;
+}
+
+void WriteProfile() {
+  const char* path = std::getenv("NINECXX_PROFILE");
+  if (!path) {
+    path = "9cxx.profile";
+  }
+
+  std::map<std::string, uint64_t> counts;
+  if (FILE* in = std::fopen(path, "r")) {
+    char name[256];
+    uint64_t count;
+    while (std::fscanf(in, "%255s %" SCNu64, name, &count) == 2) {
+      counts[name] += count;
+    }
+    std::fclose(in);
+  }
+
+  for (auto table : Tables()) {
+    auto functions = reinterpret_cast<const FunctionCounters*>(table + 1);
+    for (uint64_t i = 0; i < table[0]; ++i) {
+      const auto& f = functions[i];
+      counts[f.name] += f.counters[0];
+      for (uint64_t j = 1; j < f.num_counters; ++j) {
+        counts[std::string{f.name} + '#' + std::to_string(j - 1)] +=
+            f.counters[j];
+      }
+    }
+  }
+
+  FILE* out = std::fopen(path, "w");
+  if (!out) {
+    std::perror(path);
+    return;
+  }
+  for (const auto& [name, count] : counts) {
+    std::fprintf(out, "%s %" PRIu64 "\n", name.c_str(), count);
+  }
+  std::fclose(out);
+}
+
+} // namespace
+
+extern "C" void __9cxx_profile_register(const uint64_t* table) {
+  if (Tables().empty()) {
+    std::atexit(WriteProfile);
+  }
+  Tables().push_back(table);
+}
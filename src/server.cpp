@@ -0,0 +1,259 @@
+#include "server.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "compiler.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+const size_t kMaxCachedResults = 256;
+
+// The limits of a request. A client which sends more is disconnected, so that
+// it cannot make the server allocate without bound.
+const uint32_t kMaxArgs = 1024;
+const uint32_t kMaxArgBytes = 4096;
+const uint32_t kMaxSourceBytes = 64 << 20;
+
+// A worker gives up on a client which sends or receives nothing for this long,
+// so that a stalled client cannot hold it.
+const timeval kIoTimeout{10, 0};
+
+struct CompileResult {
+  int32_t exit_code;
+  std::string out;
+  std::string err;
+};
+
+// Keeps the results of recent requests, evicting the least recently used.
+class ResultCache {
+ public:
+  bool Find(const std::string& key, CompileResult& result) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      return false;
+    }
+    entries_.splice(entries_.begin(), entries_, it->second);
+    result = it->second->second;
+    return true;
+  }
+
+  void Insert(const std::string& key, const CompileResult& result) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (index_.count(key)) {
+      return;
+    }
+    entries_.emplace_front(key, result);
+    index_[key] = entries_.begin();
+    if (entries_.size() > kMaxCachedResults) {
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+  }
+
+ private:
+  using Entry = std::pair<std::string, CompileResult>;
+  std::mutex mutex_;
+  std::list<Entry> entries_;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+};
+
+bool WriteAll(int fd, const void* buf, size_t len) {
+  auto p = static_cast<const char*>(buf);
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool ReadAll(int fd, void* buf, size_t len) {
+  auto p = static_cast<char*>(buf);
+  while (len > 0) {
+    ssize_t n = read(fd, p, len);
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool WriteU32(int fd, uint32_t value) {
+  return WriteAll(fd, &value, sizeof(value));
+}
+
+bool ReadU32(int fd, uint32_t& value) {
+  return ReadAll(fd, &value, sizeof(value));
+}
+
+bool WriteString(int fd, const std::string& s) {
+  return WriteU32(fd, s.size()) && WriteAll(fd, s.data(), s.size());
+}
+
+// Fails if the string is longer than max_len.
+bool ReadString(int fd, std::string& s, uint32_t max_len) {
+  uint32_t len;
+  if (!ReadU32(fd, len) || len > max_len) {
+    return false;
+  }
+  s.resize(len);
+  return ReadAll(fd, &s[0], len);
+}
+
+sockaddr_un SocketAddress(const std::string& socket_path) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+  return addr;
+}
+
+void Serve(int fd, ResultCache& cache) {
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &kIoTimeout, sizeof(kIoTimeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &kIoTimeout, sizeof(kIoTimeout));
+
+  uint32_t num_args;
+  if (!ReadU32(fd, num_args) || num_args > kMaxArgs) {
+    return;
+  }
+  std::vector<std::string> args(num_args);
+  for (auto& arg : args) {
+    if (!ReadString(fd, arg, kMaxArgBytes)) {
+      return;
+    }
+  }
+  std::string src;
+  if (!ReadString(fd, src, kMaxSourceBytes)) {
+    return;
+  }
+
+  CompileOptions options;
+  for (size_t i = 0; i < args.size(); ) {
+    auto n = ParseCompileOption(args, i, options);
+    i += n > 0 ? n : 1;
+  }
+  options.num_jobs = 1;
+  // The key has the contents of the files the options name, such as the
+  // profile, so that a changed file is not served from the cache.
+  auto key = CompileOptionsKey(options) + '\0' + src;
+
+  CompileResult result;
+  if (!cache.Find(key, result)) {
+    std::ostringstream out, err;
+    result.exit_code = Compile(src, out, err, options);
+    result.out = out.str();
+    result.err = err.str();
+    cache.Insert(key, result);
+  }
+
+  WriteU32(fd, static_cast<uint32_t>(result.exit_code)) &&
+  WriteString(fd, result.out) &&
+  WriteString(fd, result.err);
+}
+
+} // namespace
+
+int RunServer(const std::string& socket_path, size_t num_workers) {
+  signal(SIGPIPE, SIG_IGN);
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    perror("socket");
+    return -1;
+  }
+  auto addr = SocketAddress(socket_path);
+  unlink(socket_path.c_str());
+  if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+      listen(listen_fd, SOMAXCONN) < 0) {
+    perror(socket_path.c_str());
+    close(listen_fd);
+    return -1;
+  }
+
+  // This thread accepts connections instead of working as worker 0, so the
+  // other workers steal its tasks.
+  ThreadPool pool{num_workers + 1};
+  ResultCache cache;
+  while (true) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("accept");
+      break;
+    }
+    pool.Submit([fd, &cache] {
+      // A request which fails, as when memory runs out, only loses its own
+      // connection.
+      try {
+        Serve(fd, cache);
+      } catch (const std::exception& e) {
+        std::cerr << "Request failed: " << e.what() << std::endl;
+      }
+      close(fd);
+    });
+  }
+
+  pool.Wait();
+  close(listen_fd);
+  return -1;
+}
+
+int RunClient(const std::string& socket_path,
+              const std::vector<std::string>& args, const std::string& src,
+              std::ostream& out, std::ostream& err, bool& connected) {
+  signal(SIGPIPE, SIG_IGN);
+  connected = false;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  auto addr = SocketAddress(socket_path);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  bool sent = WriteU32(fd, args.size());
+  for (const auto& arg : args) {
+    sent = sent && WriteString(fd, arg);
+  }
+  sent = sent && WriteString(fd, src);
+
+  uint32_t exit_code;
+  std::string result_out, result_err;
+  bool received = sent && ReadU32(fd, exit_code) &&
+                  ReadString(fd, result_out, UINT32_MAX) &&
+                  ReadString(fd, result_err, UINT32_MAX);
+  close(fd);
+  if (!received) {
+    return -1;
+  }
+
+  connected = true;
+  out << result_out;
+  err << result_err;
+  return static_cast<int32_t>(exit_code);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Serves compile requests on a Unix domain socket at socket_path. Up to
+// num_workers requests are compiled concurrently. Returns only on error.
+//
+// A request is the compile options and the source, and the response is the
+// exit code of Compile(), the assembly and the diagnostics. Each string is
+// sent as a 32-bit length followed by its bytes:
+//
+//   request:  u32 num_args, string args[num_args], string src
+//   response: i32 exit_code, string out, string err
+int RunServer(const std::string& socket_path, size_t num_workers);
+
+// Sends a compile request to the server at socket_path and writes the
+// assembly to out and the diagnostics to err. Returns the exit code of the
+// compilation. Returns false in connected if the server cannot be reached.
+int RunClient(const std::string& socket_path,
+              const std::vector<std::string>& args, const std::string& src,
+              std::ostream& out, std::ostream& err, bool& connected);
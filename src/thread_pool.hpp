@@ -0,0 +1,131 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A work-stealing thread pool.
+//
+// Each worker owns a task queue. A worker takes tasks from the back of its own
+// queue, and steals from the front of the others' queues when its own is
+// empty. The thread which calls Wait() works as one of the workers, so a pool
+// of one thread runs every task on the calling thread.
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t num_threads)
+      : queues_(num_threads > 0 ? num_threads : 1) {
+    for (size_t i = 1; i < queues_.size(); ++i) {
+      threads_.emplace_back([this, i] { WorkerLoop(i); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  // Must be called from one thread at a time.
+  void Submit(std::function<void()> task) {
+    auto& queue = queues_[next_queue_++ % queues_.size()];
+    {
+      std::lock_guard<std::mutex> lock{queue.mutex};
+      queue.tasks.push_back(std::move(task));
+    }
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      ++queued_;
+      ++unfinished_;
+    }
+    cv_.notify_one();
+  }
+
+  // Runs tasks until all submitted tasks have finished.
+  void Wait() {
+    while (true) {
+      if (RunOne(0)) {
+        continue;
+      }
+      std::unique_lock<std::mutex> lock{mutex_};
+      if (unfinished_ == 0) {
+        return;
+      }
+      cv_.wait(lock, [this] { return queued_ > 0 || unfinished_ == 0; });
+    }
+  }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void WorkerLoop(size_t index) {
+    while (true) {
+      if (RunOne(index)) {
+        continue;
+      }
+      std::unique_lock<std::mutex> lock{mutex_};
+      cv_.wait(lock, [this] { return queued_ > 0 || stop_; });
+      if (stop_) {
+        return;
+      }
+    }
+  }
+
+  // Runs a task from the index-th queue, or one stolen from another queue.
+  // Returns false if there is no task.
+  bool RunOne(size_t index) {
+    std::function<void()> task;
+    for (size_t i = 0; i < queues_.size() && !task; ++i) {
+      auto& queue = queues_[(index + i) % queues_.size()];
+      std::lock_guard<std::mutex> lock{queue.mutex};
+      if (queue.tasks.empty()) {
+        continue;
+      }
+      if (i == 0) {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+      } else {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+      }
+    }
+    if (!task) {
+      return false;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      --queued_;
+    }
+    task();
+    bool all_finished;
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      all_finished = --unfinished_ == 0;
+    }
+    if (all_finished) {
+      cv_.notify_all();
+    }
+    return true;
+  }
+
+  std::vector<Queue> queues_;
+  std::vector<std::thread> threads_;
+  size_t next_queue_ = 0;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  size_t queued_ = 0;     // tasks waiting in the queues
+  size_t unfinished_ = 0; // tasks submitted and not finished yet
+  bool stop_ = false;
+};
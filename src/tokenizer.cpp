@@ -3,6 +3,7 @@
 const std::set<std::string> kKeywords = {
   "char",
   "int",
+  "static",
 };
 
 const char* token_name_table[] = {
@@ -110,16 +111,26 @@ Token ReadToken(SourceReader& reader) {
   return {TokenType::kUnknown, 0};
 }
 
+Token ReadNextToken(SourceReader& reader) {
+  reader.SkipSpaces();
+  auto offset = reader.Offset();
+  Token token = ReadToken(reader);
+  if (token.type == TokenType::kUnknown && reader.Offset() == offset) {
+    reader.Read(reader.Current());
+  }
+  token.offset = offset;
+  // The end of the source is read as the null character after it.
+  token.length = token.type == TokenType::kEOF ? 0 : reader.Offset() - offset;
+  return token;
+}
+
 ReadResult<size_t> Tokenize(SourceReader& reader, std::vector<Token>& tokens) {
   while(true) {
-    reader.SkipSpaces();
-    Token token = ReadToken(reader);
+    Token token = ReadNextToken(reader);
+    tokens.push_back(token);
     if (token.type == TokenType::kUnknown) {
-      fprintf(stderr, "Error in Tokenize: token type is kUnknown at '%c'\n", reader.Current());
       return {false, tokens.size()};
     }
-
-    tokens.push_back(token);
     if (token.type == TokenType::kEOF) {
       return {true, tokens.size()};
     }
@@ -33,6 +33,8 @@ struct Token {
   TokenType type;
   int int_value;
   std::string string_value;
+  // Where the token is in the source, in bytes.
+  size_t offset = 0, length = 0;
 };
 
 template <typename T>
@@ -43,7 +45,8 @@ struct ReadResult {
 
 class SourceReader {
  public:
-  SourceReader(const char* src) : src_{src}, read_pos_{src} {
+  SourceReader(const char* src, size_t offset = 0)
+      : src_{src}, read_pos_{src + offset} {
   }
 
   bool Read(char expected) {
@@ -82,6 +85,11 @@ class SourceReader {
     return *read_pos_;
   }
 
+  // Returns the offset of the current character from the start of the source.
+  size_t Offset() const {
+    return read_pos_ - src_;
+  }
+
  private:
   const char* src_;
   const char* read_pos_;
@@ -90,4 +98,14 @@ class SourceReader {
 ReadResult<int> ReadInteger(SourceReader& reader);
 ReadResult<std::string> ReadId(SourceReader& reader);
 Token ReadToken(SourceReader& reader);
+
+// Skips spaces and reads a token, recording its offset and length. A character
+// which begins no token is read as a kUnknown token of length 1, so that the
+// tokens read one after another cover the whole source. The kEOF token is at the
+// end of the source and has length 0.
+Token ReadNextToken(SourceReader& reader);
+
+// Reads the tokens of the source up to the kEOF token into tokens. Fails at a
+// character which begins no token, whose kUnknown token is then the last one.
+// Returns the number of tokens read.
 ReadResult<size_t> Tokenize(SourceReader& reader, std::vector<Token>& tokens);
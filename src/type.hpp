@@ -0,0 +1,14 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+struct TypeInfo {
+  size_t size;
+  size_t align;
+};
+
+const std::map<std::string, TypeInfo> kBasicTypes{
+  {"char", {1, 1}},
+  {"int", {4, 4}},
+};
@@ -0,0 +1,135 @@
+// Checks that AST files survive a round trip and that damaged ones are
+// rejected.
+//
+// Usage: ast_file_test
+//
+// Each source is written as an AST file, opened, built back into an AST and
+// written again, which must give the same bytes. Every truncation of each file,
+// and files with a wrong magic, version or child index, must fail to open and
+// leave the AstFile usable for the next Open(). Files with a byte flipped
+// anywhere must be rejected by Open() or BuildAst(), or build into an AST.
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "../src/compiler.hpp"
+#include "../src/ast_file.hpp"
+#include "../src/tokenizer.hpp"
+#include "../src/ast.hpp"
+
+namespace {
+
+const char* const kSources[] = {
+  "int main(){1 + 2;}",
+  "int main(){int v,add();v=2;add(add(1,v),v*4);}",
+  "int main(){char c;int a,b;a=7;b=5;(c=1)=2;a+b+c;}",
+  "int main(){24==3*2*4;100/10/5;10-3+2;}",
+  "int f(int a,char b){a+b;} int main(){f(3,2);}",
+  "static int g(){2;} int n=3; char c; int main(){int a=0-7;a/2+g()+n+c;}",
+  "int f42(); int main(){{int a;a=1;{int b;b=a;}} f42();}",
+};
+
+void WriteFile(const std::string& path, const std::string& data) {
+  std::ofstream{path, std::ios::binary} << data;
+}
+
+// Returns the AST file which BuildAst() and WriteAstFile() make of the file at
+// path, or an empty string if it cannot be opened or built.
+std::string RoundTrip(AstFile& file, const std::string& path) {
+  if (!file.Open(path)) {
+    return "";
+  }
+  auto unit = BuildAst(file);
+  if (!unit) {
+    return "";
+  }
+  std::ostringstream out;
+  WriteAstFile(*unit, out);
+  return out.str();
+}
+
+// Returns the errors found in the AST file of src, which is kept at path.
+std::vector<std::string> Check(const std::string& src,
+                               const std::string& path) {
+  std::vector<std::string> errors;
+  std::ostringstream ast, err;
+  if (EmitAst(src, ast, err) != 0) {
+    return {"Cannot parse: " + err.str()};
+  }
+  auto data = ast.str();
+  WriteFile(path, data);
+
+  AstFile file;
+  if (RoundTrip(file, path) != data) {
+    errors.push_back("The round trip changes the file");
+  }
+
+  auto expect_rejected = [&](const std::string& damaged,
+                             const std::string& what) {
+    WriteFile(path, damaged);
+    if (file.Open(path)) {
+      errors.push_back("Opens with " + what);
+    }
+    // A failed Open() leaves nothing behind which spoils the next one.
+    WriteFile(path, data);
+    if (RoundTrip(file, path) != data) {
+      errors.push_back("Cannot open again after " + what);
+    }
+  };
+  for (size_t size = 0; size < data.size(); ++size) {
+    expect_rejected(data.substr(0, size),
+                    "the file cut to " + std::to_string(size) + " bytes");
+  }
+  auto damaged = data;
+  damaged[0] ^= 1;
+  expect_rejected(damaged, "a wrong magic");
+  damaged = data;
+  reinterpret_cast<AstFileHeader*>(&damaged[0])->version += 1;
+  expect_rejected(damaged, "a wrong version");
+  damaged = data;
+  auto header = reinterpret_cast<const AstFileHeader*>(data.data());
+  auto edges_offset = sizeof(AstFileHeader) +
+                      header->num_nodes * sizeof(AstFileNode);
+  reinterpret_cast<uint32_t*>(&damaged[edges_offset])[0] = header->num_nodes;
+  expect_rejected(damaged, "a child index past the last node");
+
+  for (size_t i = 0; i < data.size(); ++i) {
+    damaged = data;
+    damaged[i] ^= 0x80;
+    WriteFile(path, damaged);
+    RoundTrip(file, path);
+  }
+  return errors;
+}
+
+} // namespace
+
+int main() {
+  char path_template[] = "/tmp/9cxx-ast.XXXXXX";
+  int fd = mkstemp(path_template);
+  if (fd < 0) {
+    perror("mkstemp");
+    return 2;
+  }
+  close(fd);
+  std::string path = path_template;
+
+  size_t num_failed = 0;
+  for (const auto* src : kSources) {
+    auto errors = Check(src, path);
+    std::cout << (errors.empty() ? "[  OK  ] " : "[FAILED] ") << src
+              << std::endl;
+    for (const auto& error : errors) {
+      std::cout << "  " << error << std::endl;
+    }
+    num_failed += !errors.empty();
+  }
+  unlink(path.c_str());
+  return num_failed == 0 ? 0 : 1;
+}
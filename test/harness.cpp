@@ -0,0 +1,37 @@
+#include "harness.hpp"
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int Run(const std::vector<std::string>& argv, const std::string& stdout_path) {
+  // Everything is prepared before fork(), as the child of a multithreaded
+  // process may only call async-signal-safe functions.
+  std::vector<char*> args;
+  for (const auto& arg : argv) {
+    args.push_back(const_cast<char*>(arg.c_str()));
+  }
+  args.push_back(nullptr);
+  int out_fd = open(stdout_path.empty() ? "/dev/null" : stdout_path.c_str(),
+                    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    dup2(out_fd, 1);
+    dup2(null_fd, 2);
+    execvp(args[0], args.data());
+    _exit(127);
+  }
+  close(out_fd);
+  close(null_fd);
+
+  int status;
+  if (pid < 0 || waitpid(pid, &status, 0) < 0) {
+    return -1;
+  }
+  if (WIFSIGNALED(status)) {
+    return 128 + WTERMSIG(status);
+  }
+  return WEXITSTATUS(status);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "../src/compiler.hpp"
+
+// What test/runner and fuzz/differential share to assemble, link and run the
+// programs they compile in process.
+
+#ifdef __APPLE__
+const char kFormat[] = "macho64"; // the nasm output format
+const bool kLeadingUnderscore = true;
+const char kNoPieLinkFlag[] = "-Wl,-no_pie";
+#else
+const char kFormat[] = "elf64";
+const bool kLeadingUnderscore = false;
+const char kNoPieLinkFlag[] = "-no-pie";
+#endif
+
+// A way to compile and link each program.
+struct Pass {
+  PicMode pic_mode;
+  std::vector<std::string> link_flags;
+  const char* option; // the 9cxx option which selects pic_mode, if any
+};
+
+// Programs are compiled as non-PIC code, the default, and linked into a
+// non-PIE executable. An extra pass compiles them with -fPIE and links a PIE.
+const Pass kPasses[] = {
+  {PicMode::kNone, {kNoPieLinkFlag}, ""},
+  {PicMode::kPie, {}, "-fPIE"},
+};
+
+// Runs argv and waits for it. stdout goes to stdout_path if given, and stderr
+// is discarded. Returns the exit status as a shell reports it. May be called
+// from several threads.
+int Run(const std::vector<std::string>& argv,
+        const std::string& stdout_path = "");
@@ -0,0 +1,138 @@
+// Checks that the language server reports the same syntax errors after edits
+// as for the edited text opened afresh.
+//
+// Usage: lsp_test [NUM_EDITS]
+//
+// Random pieces of declarations, statements and bad characters are inserted
+// over random ranges of a document, one didChange at a time. After each edit
+// the whole text is opened as a second document, and the diagnostics published
+// for both must be equal. The edits are the same on each run.
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/lsp.hpp"
+
+namespace {
+
+const char* const kPieces[] = {
+  "int h(){1;}\n", "int h(){1;}\n", "int v=1;\n", "int v=1;\n",
+  "int ", "f", "(", ")", "{", "}", ";", "=", "==", "!", "!=", " ", "\n",
+  "a", "1", "+", ",", "x(y)", "@", "static ",
+};
+
+std::string Quote(const std::string& s) {
+  std::string quoted = "\"";
+  for (auto c : s) {
+    if (c == '\n') {
+      quoted += "\\n";
+    } else {
+      if (c == '"' || c == '\\') {
+        quoted += '\\';
+      }
+      quoted += c;
+    }
+  }
+  return quoted + '"';
+}
+
+// Returns the LSP position of offset in text.
+std::string Position(const std::string& text, size_t offset) {
+  auto line_begin = text.rfind('\n', offset == 0 ? 0 : offset - 1);
+  line_begin = line_begin == std::string::npos || offset == 0 ?
+               0 : line_begin + 1;
+  size_t line = 0;
+  for (size_t i = 0; i < line_begin; ++i) {
+    line += text[i] == '\n';
+  }
+  return "{\"line\":" + std::to_string(line) + ",\"character\":" +
+         std::to_string(offset - line_begin) + "}";
+}
+
+void Send(std::ostream& out, const std::string& method,
+          const std::string& params) {
+  std::string content = "{\"jsonrpc\":\"2.0\",\"method\":" + Quote(method) +
+                        ",\"params\":" + params + "}";
+  out << "Content-Length: " << content.size() << "\r\n\r\n" << content;
+}
+
+void Open(std::ostream& out, const std::string& uri, const std::string& text) {
+  Send(out, "textDocument/didOpen",
+       "{\"textDocument\":{\"uri\":" + Quote(uri) + ",\"text\":" +
+       Quote(text) + "}}");
+}
+
+// Returns the diagnostics of each publishDiagnostics notification in out.
+std::vector<std::string> Diagnostics(const std::string& out) {
+  const std::string kDiagnostics = "\"diagnostics\":";
+  std::vector<std::string> diagnostics;
+  for (auto pos = out.find(kDiagnostics); pos != std::string::npos;
+       pos = out.find(kDiagnostics, pos + 1)) {
+    auto begin = pos + kDiagnostics.size();
+    auto end = out.find("Content-Length:", begin);
+    diagnostics.push_back(out.substr(begin, end - begin));
+  }
+  return diagnostics;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  size_t num_edits = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+  std::mt19937 random{1};
+  auto uniform = [&random](size_t n) {
+    return std::uniform_int_distribution<size_t>{0, n - 1}(random);
+  };
+  const size_t kRemovedLengths[] = {0, 0, 0, 1, 2, 5, 12};
+  const size_t kNumPieces[] = {0, 1, 1, 2, 3};
+
+  std::ostringstream in;
+  std::vector<std::string> texts;
+  std::string text;
+  Open(in, "edited", text);
+  for (size_t i = 0; i < num_edits; ++i) {
+    auto begin = uniform(text.size() + 1);
+    auto end = std::min(text.size(), begin + kRemovedLengths[uniform(7)]);
+    std::string piece;
+    for (auto n = kNumPieces[uniform(5)]; n > 0; --n) {
+      piece += kPieces[uniform(std::size(kPieces))];
+    }
+    Send(in, "textDocument/didChange",
+         "{\"textDocument\":{\"uri\":\"edited\"},\"contentChanges\":"
+         "[{\"range\":{\"start\":" + Position(text, begin) + ",\"end\":" +
+         Position(text, end) + "},\"text\":" + Quote(piece) + "}]}");
+    text.replace(begin, end - begin, piece);
+    Open(in, "fresh", text);
+    texts.push_back(text);
+  }
+  Send(in, "exit", "null");
+
+  std::istringstream server_in{in.str()};
+  std::ostringstream server_out;
+  RunLanguageServer(server_in, server_out);
+  auto diagnostics = Diagnostics(server_out.str());
+  if (diagnostics.size() != 1 + 2 * num_edits) {
+    std::cout << "[FAILED] " << diagnostics.size() << " diagnostics for "
+              << num_edits << " edits" << std::endl;
+    return 1;
+  }
+  size_t num_failed = 0;
+  for (size_t i = 0; i < num_edits; ++i) {
+    const auto& edited = diagnostics[1 + 2 * i];
+    const auto& fresh = diagnostics[2 + 2 * i];
+    if (edited != fresh && ++num_failed <= 3) {
+      std::cout << "[FAILED] edit " << i << " of " << Quote(texts[i])
+                << std::endl << "  after the edit: " << edited << std::endl
+                << "  opened afresh: " << fresh << std::endl;
+    }
+  }
+  std::cout << num_edits - num_failed << " edits passed, " << num_failed
+            << " failed" << std::endl;
+  return num_failed == 0 ? 0 : 1;
+}
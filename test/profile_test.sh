@@ -0,0 +1,64 @@
+#!/bin/sh
+
+# Builds a program with -fprofile-generate, runs it to write a profile, and
+# compiles it again with -fprofile-use=PROFILE. The program must exit with the
+# same code both times. On ELF, f, which takes nearly all calls, must be placed
+# in .text.hot, g, which is never called, in .text.unlikely, and main, which is
+# called once, in .text.
+
+CXX=$(dirname $0)/../src/9cxx
+RT=$(dirname $0)/../src/libninecxx_rt.a
+
+FORMAT=elf64
+CLANGFLAGS="-no-pie"
+CXXFLAGS="-fno-leading-underscore"
+if [ "$(uname -s)" = "Darwin" ]
+then
+    FORMAT=macho64
+    CLANGFLAGS="-Wl,-no_pie"
+    CXXFLAGS=""
+fi
+
+TESTCASE="int n; int f(int a){int b;b=a+1;n=n+b;} int g(){2;}
+int main(){f(1);f(2);f(3);f(4);f(5);f(6);f(7);f(8);f(9);f(10);n;}"
+EXPECTED_CODE=65
+
+DIR=$(mktemp -d)
+trap 'rm -rf $DIR' EXIT
+
+fail() {
+    echo "[FAILED] profile round trip: $1"
+    exit 255
+}
+
+echo "$TESTCASE" | $CXX $CXXFLAGS -fprofile-generate > $DIR/gen.s ||
+    fail "-fprofile-generate does not compile"
+nasm $DIR/gen.s -f $FORMAT -o $DIR/gen.o
+clang++ $DIR/gen.o $RT $CLANGFLAGS -o $DIR/gen.out
+NINECXX_PROFILE=$DIR/profile $DIR/gen.out
+ACTUAL_CODE=$?
+[ $ACTUAL_CODE -eq $EXPECTED_CODE ] ||
+    fail "instrumented code $ACTUAL_CODE, expected $EXPECTED_CODE"
+[ -f $DIR/profile ] || fail "no profile written"
+
+echo "$TESTCASE" | $CXX $CXXFLAGS -fprofile-use=$DIR/profile > $DIR/use.s ||
+    fail "-fprofile-use does not compile"
+nasm $DIR/use.s -f $FORMAT -o $DIR/use.o
+clang++ $DIR/use.o $CLANGFLAGS -o $DIR/use.out
+$DIR/use.out
+ACTUAL_CODE=$?
+[ $ACTUAL_CODE -eq $EXPECTED_CODE ] ||
+    fail "optimized code $ACTUAL_CODE, expected $EXPECTED_CODE"
+
+# The section in which each function is defined.
+section_of() {
+    awk -v fn="$1:" '$1 == "section" { s = $2 } $1 == fn { print s }' \
+        $DIR/use.s
+}
+if [ $FORMAT = elf64 ]
+then
+    [ "$(section_of f)" = .text.hot ] || fail "f is in $(section_of f)"
+    [ "$(section_of g)" = .text.unlikely ] || fail "g is in $(section_of g)"
+    [ "$(section_of main)" = .text ] || fail "main is in $(section_of main)"
+fi
+echo "[  OK  ] profile round trip"
@@ -13,8 +13,10 @@ EXPECTED_OUT="$4"
 
 CXX=$(dirname $0)/../src/9cxx
 
+# Each case runs as non-PIC code in a non-PIE executable, then again with
+# -fPIE in a PIE executable.
 FORMAT=elf64
-CLANGFLAGS=""
+CLANGFLAGS="-no-pie"
 CXXFLAGS="-fno-leading-underscore"
 if [ "$(uname -s)" = "Darwin" ]
 then
@@ -28,56 +30,61 @@ then
     TESTCASE=$(cat "$TESTCASE.cpp")
 fi
 
-if [ "$QUIET" = "y" ]
-then
-    echo "$TESTCASE" | $CXX $CXXFLAGS 2>/dev/null > $(dirname $0)/testcase.s
-else
-    echo "$TESTCASE" | $CXX $CXXFLAGS > $(dirname $0)/testcase.s
-fi
-COMPILE_ACTUAL_CODE=$?
-if [ $COMPILE_ACTUAL_CODE -ne $COMPILE_CODE ]
-then
-    echo "[FAILED] testcase $TESTCASE"
-    echo "  Actual compile code $COMPILE_ACTUAL_CODE, expected $COMPILE_CODE"
-    exit 255
-fi
-if [ $COMPILE_ACTUAL_CODE -ne 0 ] && [ $COMPILE_ACTUAL_CODE -eq $COMPILE_CODE ]
-then
-    echo "[  OK  ] testcase $TESTCASE"
-    exit 0
-fi
-nasm $(dirname $0)/testcase.s -f $FORMAT -o $(dirname $0)/testcase.o
-clang++ $(dirname $0)/testcase.o $(dirname $0)/supplement.cpp $CLANGFLAGS -o $(dirname $0)/testcase.out
+# run_case EXTRA_CXXFLAGS EXTRA_CLANGFLAGS LABEL
+run_case() {
+    if [ "$QUIET" = "y" ]
+    then
+        echo "$TESTCASE" | $CXX $CXXFLAGS $1 2>/dev/null > $(dirname $0)/testcase.s
+    else
+        echo "$TESTCASE" | $CXX $CXXFLAGS $1 > $(dirname $0)/testcase.s
+    fi
+    COMPILE_ACTUAL_CODE=$?
+    if [ $COMPILE_ACTUAL_CODE -ne $COMPILE_CODE ]
+    then
+        echo "[FAILED] testcase $TESTCASE$3"
+        echo "  Actual compile code $COMPILE_ACTUAL_CODE, expected $COMPILE_CODE"
+        return 255
+    fi
+    if [ $COMPILE_ACTUAL_CODE -ne 0 ] && [ $COMPILE_ACTUAL_CODE -eq $COMPILE_CODE ]
+    then
+        echo "[  OK  ] testcase $TESTCASE$3"
+        return 0
+    fi
+    nasm $(dirname $0)/testcase.s -f $FORMAT -o $(dirname $0)/testcase.o
+    clang++ $(dirname $0)/testcase.o $(dirname $0)/supplement.cpp $2 -o $(dirname $0)/testcase.out
 
-$(dirname $0)/testcase.out > $(dirname $0)/actual.out
-ACTUAL_CODE=$?
+    $(dirname $0)/testcase.out > $(dirname $0)/actual.out
+    ACTUAL_CODE=$?
 
-if [ ! -f "$EXPECTED_OUT" ]
-then
-    /bin/echo -n "$EXPECTED_OUT" > $(dirname $0)/expected.out
-    EXPECTED_OUT=$(dirname $0)/expected.out
-fi
-DIFF=$(diff $(dirname $0)/actual.out $EXPECTED_OUT)
+    if [ ! -f "$EXPECTED_OUT" ]
+    then
+        /bin/echo -n "$EXPECTED_OUT" > $(dirname $0)/expected.out
+        EXPECTED_OUT=$(dirname $0)/expected.out
+    fi
+    DIFF=$(diff $(dirname $0)/actual.out $EXPECTED_OUT)
 
-TEST_FAILED=0
-if [ "$DIFF" != "" ]
-then
-    TEST_FAILED=1
-fi
+    TEST_FAILED=0
+    if [ "$DIFF" != "" ]
+    then
+        TEST_FAILED=1
+    fi
 
-if [ $ACTUAL_CODE -ne $EXPECTED_CODE ]
-then
-    TEST_FAILED=1
-fi
+    if [ $ACTUAL_CODE -ne $EXPECTED_CODE ]
+    then
+        TEST_FAILED=1
+    fi
 
-if [ $TEST_FAILED -eq 0 ]
-then
-    echo "[  OK  ] testcase $TESTCASE"
-else
-    echo "[FAILED] testcase $TESTCASE"
-    echo "  Actual code $ACTUAL_CODE, expected $EXPECTED_CODE"
-    echo "  Actual out $(cat $(dirname $0)/actual.out), expected $EXPECTED_OUT"
-    exit 255
-fi
+    if [ $TEST_FAILED -eq 0 ]
+    then
+        echo "[  OK  ] testcase $TESTCASE$3"
+    else
+        echo "[FAILED] testcase $TESTCASE$3"
+        echo "  Actual code $ACTUAL_CODE, expected $EXPECTED_CODE"
+        echo "  Actual out $(cat $(dirname $0)/actual.out), expected $EXPECTED_OUT"
+        return 255
+    fi
+}
 
+run_case "" "$CLANGFLAGS" "" || exit 255
+run_case "-fPIE" "" " -fPIE" || exit 255
 exit 0
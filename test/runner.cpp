@@ -0,0 +1,234 @@
+// Runs the test cases of test.sh in parallel, compiling them in process.
+//
+// Usage: runner [-j N] [--keep] [TEST_SH]
+//
+// The cases are the `$RUNNER "code" compile_code expected_code "expected_out"`
+// lines of TEST_SH (test.sh next to this program by default), with the meaning
+// described there. Each case runs in each of kPasses: as non-PIC code in a
+// non-PIE executable, and again with -fPIE. Each run gets its own temporary
+// directory for the assembly, the object and the executable, so runs do not
+// share files. supplement.cpp is compiled once and linked into each run. With
+// --keep, the directories of failed runs are left for inspection.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "../src/compiler.hpp"
+#include "../src/thread_pool.hpp"
+#include "harness.hpp"
+
+namespace {
+
+struct TestCase {
+  std::string code;
+  int compile_code;
+  int expected_code;
+  std::string expected_out;
+};
+
+struct TestResult {
+  bool ok;
+  std::string message;
+  double milliseconds;
+};
+
+// Splits a line into shell words. Supports double quotes with backslash
+// escapes, which is all test.sh uses.
+std::vector<std::string> SplitWords(const std::string& line) {
+  std::vector<std::string> words;
+  for (size_t i = 0; i < line.size(); ) {
+    if (isspace(line[i])) {
+      ++i;
+      continue;
+    }
+    std::string word;
+    while (i < line.size() && !isspace(line[i])) {
+      if (line[i] != '"') {
+        word += line[i++];
+        continue;
+      }
+      for (++i; i < line.size() && line[i] != '"'; ++i) {
+        if (line[i] == '\\' && i + 1 < line.size()) {
+          ++i;
+        }
+        word += line[i];
+      }
+      ++i;
+    }
+    words.push_back(word);
+  }
+  return words;
+}
+
+std::vector<TestCase> ReadTestCases(const std::string& test_sh) {
+  std::vector<TestCase> cases;
+  std::ifstream in{test_sh};
+  for (std::string line; std::getline(in, line); ) {
+    auto words = SplitWords(line);
+    if (words.size() != 5 || words[0] != "$RUNNER") {
+      continue;
+    }
+    cases.push_back({words[1], atoi(words[2].c_str()),
+                     atoi(words[3].c_str()), words[4]});
+  }
+  return cases;
+}
+
+std::string ReadFile(const std::string& path) {
+  std::ifstream in{path};
+  return {std::istreambuf_iterator<char>{in}, {}};
+}
+
+TestResult RunTestCase(const TestCase& test, const Pass& pass,
+                       const std::string& supplement_o, bool keep) {
+  auto start = std::chrono::steady_clock::now();
+  auto finish = [&](bool ok, const std::string& message) {
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return TestResult{ok, message, elapsed.count()};
+  };
+
+  CompileOptions options;
+  options.leading_underscore = kLeadingUnderscore;
+  options.pic_mode = pass.pic_mode;
+  std::ostringstream code, err;
+  int compile_code = Compile(test.code, code, err, options) & 0xff;
+  if (compile_code != test.compile_code) {
+    return finish(false, "Actual compile code " + std::to_string(compile_code) +
+                  ", expected " + std::to_string(test.compile_code));
+  }
+  if (compile_code != 0) {
+    return finish(true, "");
+  }
+
+  char dir_template[] = "/tmp/9cxx-test.XXXXXX";
+  if (!mkdtemp(dir_template)) {
+    return finish(false, "Cannot create a temporary directory");
+  }
+  std::string dir = dir_template;
+  auto s_path = dir + "/testcase.s", o_path = dir + "/testcase.o";
+  auto exe_path = dir + "/testcase.out", out_path = dir + "/actual.out";
+  std::ofstream{s_path} << code.str();
+
+  std::vector<std::string> link{"clang++", o_path, supplement_o};
+  link.insert(link.end(), pass.link_flags.begin(), pass.link_flags.end());
+  link.insert(link.end(), {"-o", exe_path});
+
+  std::string message;
+  if (Run({"nasm", s_path, "-f", kFormat, "-o", o_path}) != 0) {
+    message = "nasm failed";
+  } else if (Run(link) != 0) {
+    message = "Link failed";
+  } else {
+    int actual_code = Run({exe_path}, out_path);
+    auto actual_out = ReadFile(out_path);
+    // As in run_testcase.sh, expected_out names a file if there is one.
+    auto expected_out = test.expected_out;
+    if (!expected_out.empty() && access(expected_out.c_str(), R_OK) == 0) {
+      expected_out = ReadFile(expected_out);
+    }
+    if (actual_code != test.expected_code || actual_out != expected_out) {
+      message = "Actual code " + std::to_string(actual_code) + ", expected " +
+                std::to_string(test.expected_code) + "\n  Actual out " +
+                actual_out + ", expected " + expected_out;
+    }
+  }
+
+  if (message.empty() || !keep) {
+    for (const auto& path : {s_path, o_path, exe_path, out_path}) {
+      unlink(path.c_str());
+    }
+    rmdir(dir.c_str());
+  } else {
+    message += "\n  Files kept in " + dir;
+  }
+  return finish(message.empty(), message);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  std::string self = argv[0];
+  std::string test_dir = self.substr(0, self.find_last_of('/') + 1);
+  std::string test_sh = test_dir + "test.sh";
+  size_t num_jobs = std::max(std::thread::hardware_concurrency(), 1u);
+  bool keep = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-j" && i + 1 < argc) {
+      num_jobs = std::max(atoi(argv[++i]), 1);
+    } else if (arg == "--keep") {
+      keep = true;
+    } else if (arg[0] != '-') {
+      test_sh = arg;
+      test_dir = arg.substr(0, arg.find_last_of('/') + 1);
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [-j N] [--keep] [TEST_SH]"
+                << std::endl;
+      return 2;
+    }
+  }
+
+  auto cases = ReadTestCases(test_sh);
+  if (cases.empty()) {
+    std::cerr << "No test cases in " << test_sh << std::endl;
+    return 2;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  char supplement_template[] = "/tmp/9cxx-supplement.XXXXXX";
+  int fd = mkstemp(supplement_template);
+  if (fd < 0) {
+    perror("mkstemp");
+    return 2;
+  }
+  close(fd);
+  std::string supplement_o = supplement_template;
+  if (Run({"clang++", "-c", "-x", "c++", test_dir + "supplement.cpp",
+           "-o", supplement_o}) != 0) {
+    std::cerr << "Cannot compile supplement.cpp" << std::endl;
+    unlink(supplement_o.c_str());
+    return 2;
+  }
+
+  // Result i is that of case i / kNumPasses in pass i % kNumPasses.
+  const size_t kNumPasses = std::size(kPasses);
+  std::vector<TestResult> results(cases.size() * kNumPasses);
+  ThreadPool pool{num_jobs};
+  for (size_t i = 0; i < results.size(); ++i) {
+    pool.Submit([&, i] {
+      results[i] = RunTestCase(cases[i / kNumPasses], kPasses[i % kNumPasses],
+                               supplement_o, keep);
+    });
+  }
+  pool.Wait();
+  unlink(supplement_o.c_str());
+
+  size_t num_failed = 0;
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto& pass = kPasses[i % kNumPasses];
+    printf("[%s] testcase %s%s%s (%.1f ms)\n",
+           results[i].ok ? "  OK  " : "FAILED",
+           cases[i / kNumPasses].code.c_str(), *pass.option ? " " : "",
+           pass.option, results[i].milliseconds);
+    if (!results[i].ok) {
+      printf("  %s\n", results[i].message.c_str());
+      ++num_failed;
+    }
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  printf("%zu passed, %zu failed in %.2f s on %zu threads\n",
+         results.size() - num_failed, num_failed, elapsed.count(), num_jobs);
+  return num_failed == 0 ? 0 : 1;
+}
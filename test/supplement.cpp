@@ -5,3 +5,27 @@ extern "C" int f42() {
 extern "C" int add(int a, int b) {
   return a + b;
 }
+
+extern "C" int weighted8(int a, int b, int c, int d,
+                         int e, int f, int g, int h) {
+  return a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * f + 7 * g + 8 * h;
+}
+
+extern "C" int stack_aligned() {
+  return reinterpret_cast<unsigned long>(__builtin_frame_address(0)) % 16 == 0;
+}
+
+extern "C" int throw42() {
+  throw 42;
+}
+
+// Defined by a test case, for exceptions to unwind through.
+extern "C" int unwind_through() __attribute__((weak));
+
+extern "C" int catch_thrown() {
+  try {
+    return unwind_through();
+  } catch (int e) {
+    return e;
+  }
+}
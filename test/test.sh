@@ -10,9 +10,53 @@ export QUIET=y
 #    param 4: expected target program's output
 $RUNNER "int main(){1 + 2;}" 0 3 ""
 $RUNNER "int main(){1+;}" 255 0 ""
+$RUNNER "int main(){1+; {2 3;} 0;} int f(){4;}" 255 0 ""
+$RUNNER "int main(){int a=/2;}" 255 0 ""
+$RUNNER "int main(){(*3);}" 255 0 ""
+$RUNNER "int main(){()(1);}" 255 0 ""
 $RUNNER "int main(){5/2;}" 0 2 ""
 $RUNNER "int main(){(1-3)*(1+3);}" 0 248 ""
 $RUNNER "int main(){24==3*2*4;}" 0 1 ""
 $RUNNER "int main(){int f42();f42();}" 0 42 ""
 $RUNNER "int main(){int v,add();v=2;add(add(1,v),v*4);}" 0 11 ""
 $RUNNER "int f3(){3;} int f42(); int main(){int add(); add(f3(),f42());}" 0 45 ""
+$RUNNER "int main(){char c;int i;c=3;i=4;c+i;}" 0 7 ""
+$RUNNER "int main(){char c;c=255;c==0-1;}" 0 1 ""
+$RUNNER "int main(){10-3+2;}" 0 9 ""
+$RUNNER "int main(){100/10/5;}" 0 2 ""
+$RUNNER "int main(){char c;int a,b;a=7;b=5;(c=1)=2;a+b+c;}" 0 14 ""
+$RUNNER "int main(){int a,b;char c,d;b=7;d=5;(c=1)=2;a=0;a+b+c+d;}" 0 14 ""
+$RUNNER "int main(){int a=0-7;a/2;}" 0 253 ""
+$RUNNER "int main(){(0-7)/2;}" 0 253 ""
+$RUNNER "int g=(0-7)/2; int main(){g;}" 0 253 ""
+$RUNNER "int g=1/0; int main(){g;}" 255 0 ""
+$RUNNER "int main(){int a;a=1;{int a;a=5;}a;}" 0 1 ""
+$RUNNER "int main(){int r;r=0;{int x;x=3;r=r+x;}{char y;y=4;r=r+y;}r;}" 0 7 ""
+$RUNNER "int main(){int a,b;a=3;b=4;a*b+a*b;}" 0 24 ""
+$RUNNER "int f3(){3;} int main(){int a;a=2;(f3()+a)*(a+f3());}" 0 25 ""
+$RUNNER "int main(){int a,b;a=3;b=a*a;(a=1)=2;b+a*a;}" 0 13 ""
+$RUNNER "int main(){int weighted8();weighted8(1,2,3,4,5,6,7,8);}" 0 204 ""
+$RUNNER "int main(){int weighted8(),add();weighted8(add(1,0),2,add(1,2),4,5,6,7,add(4,4));}" 0 204 ""
+$RUNNER "int main(){int stack_aligned();stack_aligned()+0;}" 0 1 ""
+$RUNNER "int sub(int a,char b){a-b;} int main(){sub(10,3);}" 0 7 ""
+$RUNNER "int g(int a,int b,int c){a*c+c;} int main(){g(2,3,4);}" 0 12 ""
+$RUNNER "int w(int a,int b,int c,int d,int e,int f,int g,int h){a+h*10;} int main(){w(1,2,3,4,5,6,7,8);}" 0 81 ""
+$RUNNER "int f(int x){x*x*x;} int main(){f(2);}" 0 8 ""
+$RUNNER "int f(int a,char b){(a=1)=2;(b=a)=3;a+b;} int main(){f(5,6);}" 0 5 ""
+$RUNNER "int f(int a){int b;b=a*a;(a=1)=2;b+a*a;} int main(){f(3);}" 0 13 ""
+$RUNNER "int main(){x;}" 255 0 ""
+$RUNNER "int main(){1=2;}" 255 0 ""
+$RUNNER "int main(){int a=3,b=4;a*b;}" 0 12 ""
+$RUNNER "int g; int main(){g=3;g+1;}" 0 4 ""
+$RUNNER "int g=2*3+1; char c=300; int main(){g+c;}" 0 51 ""
+$RUNNER "int g=1; int f(){g=g+1;} int main(){int a=f();f()+a;}" 0 5 ""
+$RUNNER "int a; int b=a; int main(){b;}" 255 0 ""
+$RUNNER "int f3(){3;} int sq(int x){x*x;} int main(){sq(f3())+f3();}" 0 12 ""
+$RUNNER "int c(char x){x;} int f(int a){char c;c=a;c;} int main(){c(300)+f(200)+1;}" 0 245 ""
+$RUNNER "int f(int a){int b=a*2;b=b+1;b;} int g=f(3); int main(){g;}" 0 7 ""
+$RUNNER "int g=f(1); int f(int a){a;} int main(){0;}" 255 0 ""
+$RUNNER "static int h(int a,int b){a*b+1;} static int dead(){h(1,2);} int main(){h(3,4)+h(3,5);}" 0 29 ""
+$RUNNER "int g; static int add(int a,int b){g=g+a;b*2;} static int twice(int n){add(n,5)+add(n,5);} int main(){twice(3)+twice(3)+g;}" 0 40 ""
+$RUNNER "static char c; static int k=3; int main(){c=k;c+1;}" 0 4 ""
+$RUNNER "int f(static int a){a;} int main(){0;}" 255 0 ""
+$RUNNER "int throw42(); int f(int a){int b=a;throw42()+b;} int unwind_through(){f(1)+2;} int catch_thrown(); int main(){catch_thrown();}" 0 42 ""
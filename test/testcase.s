@@ -0,0 +1,126 @@
+section .eh_frame progbits alloc noexec nowrite align=8
+__9cxx_cie:
+  dd 20
+  dd 0
+  db 1
+  db "zR", 0
+  db 1
+  db 0x78
+  db 16
+  db 1
+  db 0x1b
+  db 0x0c, 7, 8
+  db 0x90, 1
+  db 0, 0
+section .text
+  extern throw42
+global f:function (f.end - f)
+f:
+.start:
+  push rbp
+.frame_pushed:
+  mov rbp, rsp
+.frame_set:
+  sub rsp, 16
+  mov dword [rbp - 4], edi
+  mov eax, dword [rbp - 4]
+  mov dword [rbp - 8], eax
+  mov eax, dword [rbp - 8]
+  push rax
+  sub rsp, 8
+  call throw42 wrt ..plt
+  add rsp, 8
+  pop r11
+  add eax, r11d
+  mov rsp, rbp
+  pop rbp
+.frame_popped:
+  ret
+.end:
+section .eh_frame progbits alloc noexec nowrite align=8
+  dd 44
+  dd $ - __9cxx_cie
+  dd f.start - $
+  dd f.end - f.start
+  db 0
+  db 0x04
+  dd f.frame_pushed - f.start
+  db 0x0e, 16
+  db 0x86, 2
+  db 0x04
+  dd f.frame_set - f.frame_pushed
+  db 0x0d, 6
+  db 0x04
+  dd f.frame_popped - f.frame_set
+  db 0x0c, 7, 8
+  db 0, 0, 0, 0, 0, 0, 0
+section .text
+global unwind_through:function (unwind_through.end - unwind_through)
+unwind_through:
+.start:
+  push rbp
+.frame_pushed:
+  mov rbp, rsp
+.frame_set:
+  mov eax, 2
+  push rax
+  sub rsp, 8
+  mov eax, 1
+  mov edi, eax
+  call f
+  add rsp, 8
+  pop r11
+  add eax, r11d
+  pop rbp
+.frame_popped:
+  ret
+.end:
+section .eh_frame progbits alloc noexec nowrite align=8
+  dd 44
+  dd $ - __9cxx_cie
+  dd unwind_through.start - $
+  dd unwind_through.end - unwind_through.start
+  db 0
+  db 0x04
+  dd unwind_through.frame_pushed - unwind_through.start
+  db 0x0e, 16
+  db 0x86, 2
+  db 0x04
+  dd unwind_through.frame_set - unwind_through.frame_pushed
+  db 0x0d, 6
+  db 0x04
+  dd unwind_through.frame_popped - unwind_through.frame_set
+  db 0x0c, 7, 8
+  db 0, 0, 0, 0, 0, 0, 0
+section .text
+  extern catch_thrown
+global main:function (main.end - main)
+main:
+.start:
+  push rbp
+.frame_pushed:
+  mov rbp, rsp
+.frame_set:
+  call catch_thrown wrt ..plt
+  pop rbp
+.frame_popped:
+  ret
+.end:
+section .eh_frame progbits alloc noexec nowrite align=8
+  dd 44
+  dd $ - __9cxx_cie
+  dd main.start - $
+  dd main.end - main.start
+  db 0
+  db 0x04
+  dd main.frame_pushed - main.start
+  db 0x0e, 16
+  db 0x86, 2
+  db 0x04
+  dd main.frame_set - main.frame_pushed
+  db 0x0d, 6
+  db 0x04
+  dd main.frame_popped - main.frame_set
+  db 0x0c, 7, 8
+  db 0, 0, 0, 0, 0, 0, 0
+section .text